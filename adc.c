@@ -4,12 +4,13 @@
 ** ADC for temperature sensor and Vrefint
 ** gpioa low level API and usleep()
 ** interrupt based serial transmission
-** clocks configuration: HSI, HSE, PLL HSI, PLL HSE
+** clocks configuration: HSI, HSE, PLL HSI, PLL HSE, switched at runtime
 ** implements system.h interface: uptime, init(), kputc(), kputs(), yield()
+** idle manager: Sleep, Sleep-on-exit or Stop selected by yield()
 ** uptime = seconds elapsed since boot
 ** Serial tx, SysClck 8MHz HSI based, baudrate 9600, Busy wait transmission
 ** user LED toggled every second
-** SysTick interrupt every second
+** SysTick interrupt every millisecond, drives timer.c software timers
 */
 
 #include "system.h" /* implements system.h */
@@ -25,8 +26,16 @@
 #define NVIC                    ((volatile long *) 0xE000E100)
 #define NVIC_ISER               NVIC[ 0]
 #define unmask_irq( idx)        NVIC_ISER = 1 << idx
+#define TIM16_IRQ_IDX           21
 #define USART1_IRQ_IDX          27
 
+#define SCB_ICSR                (*(volatile long *) 0xE000ED04)
+#define SCB_ICSR_PENDSTSET      (1 << 26)   /* 26: SysTick pending */
+
+#define SCB_SCR                 (*(volatile long *) 0xE000ED10)
+#define SCB_SCR_SLEEPONEXIT     2   /* 1: Sleep on return to thread mode */
+#define SCB_SCR_SLEEPDEEP       4   /* 2: Deep sleep, Stop mode */
+
 
 /** PERIPH ********************************************************************/
 
@@ -62,15 +71,59 @@
 
 #define RCC_APB2ENR             RCC[ 6]
 #define RCC_APB2ENR_USART1EN    0x00004000  /* 14: USART1 clock enable */
+#define RCC_APB2ENR_TIM16EN     0x00020000  /* 17: TIM16 clock enable */
 #define RCC_APB2ENR_ADCEN       0x00000200  /*  9: ADC clock enable */
 
 #define RCC_CFGR2               RCC[ 11]    /* 3-0: PLL PREDIV */
 
+#define RCC_APB1ENR             RCC[ 7]
+#define RCC_APB1ENR_PWREN       (1 << 28)   /* 28: Power interface enable */
+
+#define RCC_BDCR                RCC[ 8]
+#define RCC_BDCR_RTCSEL         (3 << 8)    /* 9-8: RTC clock source */
+#define RCC_BDCR_RTCSEL_LSI     (2 << 8)    /* 9-8: LSI */
+#define RCC_BDCR_RTCEN          (1 << 15)   /* 15: RTC clock enable */
+#define RCC_BDCR_BDRST          (1 << 16)   /* 16: Backup domain reset */
+
+#define RCC_CSR                 RCC[ 9]
+#define RCC_CSR_LSION           1           /*  0: LSI oscillator enable */
+#define RCC_CSR_LSIRDY          2           /*  1: LSI oscillator ready */
+
 #define RCC_CR2                 RCC[ 13]
 #define RCC_CR2_HSI14ON         0x00000001  /*  1: HSI14 clock enable */
 #define RCC_CR2_HSI14RDY        0x00000002  /*  2: HSI14 clock ready */
 
 
+#define PWR                     ((volatile long *) 0x40007000)
+#define PWR_CR                  PWR[ 0]
+#define PWR_CR_LPDS             1           /*  0: LP regulator in Stop mode */
+#define PWR_CR_PDDS             2           /*  1: Standby instead of Stop */
+#define PWR_CR_DBP              (1 << 8)    /*  8: Backup domain write access */
+
+#define RTC                     ((volatile long *) 0x40002800)
+#define RTC_CR                  RTC[ 2]
+#define RTC_CR_ALRAE            (1 << 8)    /*  8: Alarm A enable */
+#define RTC_CR_ALRAIE           (1 << 12)   /* 12: Alarm A interrupt enable */
+#define RTC_ISR                 RTC[ 3]
+#define RTC_ISR_ALRAWF          1           /*  0: Alarm A write allowed */
+#define RTC_ISR_INITF           (1 << 6)    /*  6: Initialization mode */
+#define RTC_ISR_INIT            (1 << 7)    /*  7: Enter initialization */
+#define RTC_ISR_ALRAF           (1 << 8)    /*  8: Alarm A flag */
+#define RTC_PRER                RTC[ 4]     /* Prescaler */
+#define RTC_ALRMAR              RTC[ 7]     /* Alarm A */
+#define RTC_ALRMAR_MSKALL       0x80808080  /* date, hours, min, sec masked */
+#define RTC_WPR                 RTC[ 9]     /* Write protection */
+
+#define EXTI                    ((volatile long *) 0x40010400)
+#define EXTI_EMR                EXTI[ 1]    /* Event mask */
+#define EXTI_RTSR               EXTI[ 2]    /* Rising trigger selection */
+#define EXTI_PR                 EXTI[ 5]    /* Pending */
+#define EXTI_RTCALARM           (1 << 17)   /* 17: RTC alarm */
+
+#define FLASH                   ((volatile long *) 0x40022000)
+#define FLASH_ACR               FLASH[ 0]
+#define FLASH_ACR_LATENCY       1           /*  0: One wait state */
+
 #define GPIOA                   ((volatile long *) 0x48000000)
 #define GPIOB                   ((volatile long *) 0x48000400)
 #define GPIO( x) CAT( GPIO, x)
@@ -86,6 +139,7 @@
 
 #define ADC_CR                  ADC[ 2]
 #define ADC_CR_ADEN             1   /* 0: ADc ENable command */
+#define ADC_CR_ADDIS            2   /* 1: ADC Disable command */
 #define ADC_CR_ADSTART          4   /* 2: ADC Start Conversion command */
 #define ADC_CR_ADCAL            (1 << 31)   /* 31: ADC Start Calibration cmd */
 
@@ -106,6 +160,20 @@
 #define ADC_CCR_VREFEN          (1 << 22)   /* 22: Vrefint Enable */
 #define ADC_CCR_TSEN            (1 << 23)   /* 23: Temperature Sensor Enable */
 
+#define TIM16                   ((volatile long *) 0x40014400)
+#define TIM16_CR1               TIM16[ 0]
+#define TIM16_DIER              TIM16[ 3]
+#define TIM16_SR                TIM16[ 4]
+#define TIM16_EGR               TIM16[ 5]
+#define TIM16_PSC               TIM16[ 10]
+#define TIM16_ARR               TIM16[ 11]
+#define TIM_CR1_CEN             1           /*  0: Counter enable */
+#define TIM_CR1_URS             4           /*  2: Update on overflow only */
+#define TIM_CR1_OPM             8           /*  3: One pulse mode */
+#define TIM_DIER_UIE            1           /*  0: Update interrupt enable */
+#define TIM_SR_UIF              1           /*  0: Update interrupt flag */
+#define TIM_EGR_UG              1           /*  0: Update generation */
+
 #define USART1                  ((volatile long *) 0x40013800)
 #define CR1     0               /* Config Register */
 #define BRR     3               /* BaudRate Register */
@@ -115,6 +183,7 @@
 #define USART_CR1_TE    8           /* 3: Transmit Enable */
 #define USART_CR1_RE    4           /* 2: Receive Enable */
 #define USART_CR1_UE    1           /* 0: USART Enable */
+#define USART_ISR_TC    (1 << 6)    /* 6: Transmission Complete */
 #define USART_ISR_TXE   (1 << 7)    /* 7: Transmit Data Register Empty */
 
 
@@ -128,55 +197,45 @@
 #define LED_IOP A
 #define LED_PIN 4
 #define LED_ON  0
-/* 8MHz quartz, configure PLL at 16MHz */
+/* HSI, configure PLL at 24MHz */
 //#define HSE     8000000
-//#define HSEPRE  4
-#define PLL     6
+#define SYSCLK  24000000
 #define BAUD    9600
 //#define HSI14 1
-
-#ifdef PLL
-# ifdef HSE
-#  ifdef HSEPRE
-#   define CLOCK HSE / HSEPRE * PLL
-#  else
-#   define CLOCK HSE / 2 * PLL
-#  endif
-# else /* HSI */
-#  define CLOCK 8000000 / 2 * PLL
-# endif
-# if CLOCK < 16000000
-#  error PLL output below 16MHz
-# endif
-#elif defined( HSE)
-# define CLOCK HSE
-#else /* HSI */
-# define CLOCK 8000000
+/* Stop mode when idle, uptime then follows LSI accuracy (30~50 kHz) */
+//#define IDLESTOP    1
+#define IDLESTOP_MIN    2000        /* us before tick to consider Stop mode */
+#define LSI             40000
+#ifndef IDLESTOP
+# define TICK   1000                /* SysTick rate, ms software timers */
 #endif
 
-#if CLOCK > 48000000
-# error clock frequency exceeds 48MHz
-#endif
+#include "clocktree.h"  /* CLOCK, PLL, HSEPRE, USARTDIV, TICKDIV, ADCCKMODE */
 
-#if CLOCK > 0x1000000
-# define TICKDIV 8
+#ifdef HSE
+# define BASECLK    HSE     /* SYSCLK without PLL */
 #else
-# define TICKDIV 1
+# define BASECLK    8000000
 #endif
 
-#if CLOCK % BAUD
-# warning baud rate not accurate at that clock frequency
-#endif
+static unsigned clock_hz = CLOCK ;  /* SYSCLK, changed by clock_set() */
+static unsigned tickus = TICKUS ;   /* usleep() SysTick counts per us */
 
 static unsigned char txbuf[ 8] ; // best if size is a power of 2 for cortex-M0
 #define TXBUF_SIZE (sizeof txbuf / sizeof txbuf[ 0])
 static unsigned char            txbufin ;
 static volatile unsigned char   txbufout ;
 
-void USART1_Handler( void) {
+static volatile int wakeup ;        /* thread mode requested by handler */
+
+RAMFUNC void USART1_Handler( void) {
     if( txbufout == txbufin) {
     /* Empty buffer => Disable TXEIE */
         USART1[ CR1] &= ~USART_CR1_TXEIE ;
+        SCB_SCR &= ~SCB_SCR_SLEEPONEXIT ;   /* drained, to thread mode */
+        wakeup = 1 ;
+        if( event_post)
+            event_post( EV_TXEMPTY, 0) ;
     } else {
         static unsigned char lastc ;
         unsigned char c ;
@@ -218,11 +277,13 @@ int kputs( const char s[]) {    /* string output */
     return cnt ;
 }
 
-void yield( void) {             /* give way */
-    __asm( "WFI") ; /* Wait for System Tick Interrupt */
-}
-
 volatile unsigned uptime ;      /* seconds elapsed since boot */
+static volatile unsigned ticks ;    /* SysTick periods since boot */
+
+/* now_cycles() counts from the last clock_set() at the current clock_hz */
+static unsigned long long cycle_base ;  /* HCLK cycles before the switch */
+static unsigned base_ticks ;            /* now_sample() after the switch */
+static unsigned base_counts ;
 
 #ifdef LED_ON
 static void userLEDtoggle( void) {
@@ -230,20 +291,169 @@ static void userLEDtoggle( void) {
 }
 #endif
 
-void SysTick_Handler( void) {
+RAMFUNC void SysTick_Handler( void) {
+    ticks += 1 ;
+    if( timer_tick && timer_tick( 1000 / TICK)) {
+        SCB_SCR &= ~SCB_SCR_SLEEPONEXIT ;   /* timers due, to thread mode */
+        wakeup = 1 ;
+    }
+
+#if TICK > 1
+    static unsigned subtick ;
+
+    if( ++subtick < TICK)
+        return ;
+
+    subtick = 0 ;
+#endif
+    SCB_SCR &= ~SCB_SCR_SLEEPONEXIT ;   /* back to thread mode on exit */
+    wakeup = 1 ;
     uptime += 1 ;
+    if( event_post)
+        event_post( EV_SECOND, uptime) ;
+
 #ifdef LED_ON
     userLEDtoggle() ;
 #endif
 }
 
 
-void usleep( unsigned usecs) {      /* wait at least usecs µs */
-#if CLOCK % (TICKDIV * 1000000)
-# warning usleep() not accurate at that clock frequency
-#endif
-    usecs = SYSTICK_CVR - (CLOCK / TICKDIV / 1000000 * usecs) ;
-    while( SYSTICK_CVR > usecs) ;
+/* usleep() and usleep_async() on TIM16 one-shot, 1us resolution, waits
+** over 32768us are chained from TIM16_Handler. usleep() spins on short waits
+** and sleeps on longer ones.
+*/
+#define USLEEP_SPIN 100             /* us, WFI from there */
+
+static volatile int usleep_busy ;       /* TIM16 in use */
+static volatile unsigned usleep_left ;  /* us after current shot */
+static void (*usleep_cb)( void) ;       /* async completion, ISR context */
+
+RAMFUNC static void tim16_shot( void) { /* next shot, at most 32768us */
+    unsigned usecs = usleep_left > 0x8000 ? 0x8000 : usleep_left ;
+
+    usleep_left -= usecs ;
+    TIM16_CR1 = TIM_CR1_OPM | TIM_CR1_URS ;     /* one-shot, stopped */
+    TIM16_PSC = clock_hz / 2000000 - 1 ;        /* 2MHz counter */
+    TIM16_ARR = 2 * usecs - 1 ;                 /* ARR 0 stops counter */
+    TIM16_EGR = TIM_EGR_UG ;                    /* load PSC, CNT = 0 */
+    TIM16_SR = 0 ;
+    TIM16_CR1 |= TIM_CR1_CEN ;
+}
+
+RAMFUNC static int tim16_arm( unsigned usecs, void (*cb)( void), int irq) {
+    if( usleep_busy)
+        return -1 ;
+
+    usleep_busy = 1 ;
+    usleep_left = usecs ? usecs : 1 ;
+    usleep_cb = cb ;
+    TIM16_DIER = irq ? TIM_DIER_UIE : 0 ;
+    tim16_shot() ;
+    return 0 ;
+}
+
+void TIM16_Handler( void) {
+    TIM16_SR = 0 ;                      /* clear UIF */
+    if( usleep_left)
+        tim16_shot() ;
+    else {
+        void (*cb)( void) = usleep_cb ;
+
+        TIM16_DIER = 0 ;
+        usleep_busy = 0 ;
+        SCB_SCR &= ~SCB_SCR_SLEEPONEXIT ;   /* released, to thread mode */
+        wakeup = 1 ;
+        if( cb)
+            cb() ;
+    }
+}
+
+int usleep_async( unsigned usecs, void (*cb)( void)) {
+    return tim16_arm( usecs, cb, 1) ;   /* -1 if TIM16 is busy */
+}
+
+/* Sleep until TIM16 is released, interrupts are masked between test and WFI
+** so that completion can't be missed, a pending interrupt still wakes up */
+RAMFUNC static void tim16_wait( void) {
+    for( ;;) {
+        __asm( "CPSID i") ;
+        if( !usleep_busy)
+            break ;
+
+        __asm( "WFI") ;
+        __asm( "CPSIE i") ;
+    }
+
+    __asm( "CPSIE i") ;
+}
+
+RAMFUNC void usleep( unsigned usecs) {      /* wait at least usecs µs */
+    tim16_wait() ;                          /* usleep_async() in progress */
+    if( usecs < USLEEP_SPIN) {
+        tim16_arm( usecs, 0, 0) ;
+        do {} while( !(TIM16_SR & TIM_SR_UIF)) ;
+        usleep_busy = 0 ;
+    } else {
+        tim16_arm( usecs, 0, 1) ;
+        tim16_wait() ;
+    }
+}
+
+
+/* High resolution time ******************************************************/
+/* SysTick periods combined with SysTick count, a reload not yet accounted for by
+** SysTick_Handler (interrupts masked or higher priority ISR) is detected by
+** PENDSTSET, SysTick count is then read again after the reload.
+*/
+static unsigned now_sample( unsigned *counts) { /* ticks, counts in tick */
+    unsigned up ;
+    unsigned cvr ;
+    int pending ;
+
+    do {
+        up = ticks ;
+        cvr = SYSTICK_CVR ;
+        pending = (SCB_ICSR & SCB_ICSR_PENDSTSET) != 0 ;
+        if( pending)
+            cvr = SYSTICK_CVR ;
+    } while( up != ticks) ;
+
+    *counts = SYSTICK_RVR - cvr ;
+    return up + pending ;
+}
+
+unsigned now_us( void) {            /* us since boot, wraps every 71 min */
+    unsigned counts ;
+    unsigned up = now_sample( &counts) ;
+
+    return up * (1000000 / TICK) + counts / tickus ;
+}
+
+unsigned long long now_us64( void) {    /* us since boot */
+    unsigned counts ;
+    unsigned long long up = now_sample( &counts) ;
+
+    return up * (1000000 / TICK) + counts / tickus ;
+}
+
+unsigned now_cycles( void) {        /* HCLK cycles since boot, wraps */
+    unsigned counts ;
+    unsigned up = now_sample( &counts) - base_ticks ;
+
+    return (unsigned) cycle_base + up * (clock_hz / TICK)
+                + (counts - base_counts) * (SYSTICK_CSR & 4 ? 1 : 8) ;
+}
+
+unsigned long long now_cycles64( void) {    /* HCLK cycles since boot */
+    unsigned counts ;
+    unsigned long long up = now_sample( &counts) - base_ticks ;
+    int delta ;
+
+/* negative in the period of the switch when the new reload value is lower
+** than the count at switch time, the sum is still positive */
+    delta = counts - base_counts ;
+    return cycle_base + up * (clock_hz / TICK)
+                + (long long) delta * (SYSTICK_CSR & 4 ? 1 : 8) ;
 }
 
 
@@ -257,25 +467,53 @@ void gpioa_output( int pin) {       /* Configure GPIOA pin as output */
     GPIOA[ MODER] |= 1 << (pin * 2) ;       /* Apin output (over [00]) */
 }
 
-iolvl_t gpioa_read( int pin) {      /* Read level of GPIOA pin */
+RAMFUNC iolvl_t gpioa_read( int pin) {  /* Read level of GPIOA pin */
     return LOW != (GPIOA[ IDR] & (1 << pin)) ;
 }
 
 
+#if ADCCKMODE != 0
+static long adc_ckmode( unsigned hz) {      /* 14MHz max ADC clock */
+    return hz / 2 > 14000000 ? ADC_CFGR2_PCLK4 : ADC_CFGR2_PCLK2 ;
+}
+
+static void adc_clock( unsigned hz) {   /* ADC clock mode valid up to hz */
+    long ckmode ;
+
+    if( !(RCC_APB2ENR & RCC_APB2ENR_ADCEN))
+        return ;    /* not initialized yet, adc_init() selects mode */
+
+    ckmode = adc_ckmode( hz) ;
+    if( (ADC_CFGR2 & ADC_CFGR2_CKMODE) == ckmode)
+        return ;
+
+/* CKMODE can only be changed with ADC disabled, calibration is kept */
+    int enabled = ADC_CR & ADC_CR_ADEN ;
+    if( enabled) {
+        ADC_CR |= ADC_CR_ADDIS ;
+        do {} while( ADC_CR & ADC_CR_ADEN) ;
+    }
+
+    ADC_CFGR2 = (ADC_CFGR2 & ~ADC_CFGR2_CKMODE) | ckmode ;
+    if( enabled)
+        do {
+            ADC_CR |= ADC_CR_ADEN ;
+        } while( !( ADC_ISR & ADC_ISR_ADRDY)) ;
+}
+#endif
+
 const unsigned short *adc_init( unsigned channels) {
 /* Enable ADC peripheral */
     RCC_APB2ENR |= RCC_APB2ENR_ADCEN ;
 /* Setup ADC sampling clock */
-#ifdef HSI14
+#if ADCCKMODE == 0
     RCC_CR2 |= RCC_CR2_HSI14ON ;                    /* Start HSI14 clock */
     do {} while( !( RCC_CR2 & RCC_CR2_HSI14RDY)) ;  /* Wait for stable clock */
 /* Select HSI14 as sampling clock for ADC */
 //  ADC_CFGR2 &= ~ADC_CFGR2_CKMODE ;    /* Default 00 == HSI14 */
-#elif CLOCK <= 28000000
-/* Select PCLK/2 as sampling clock for ADC */
-    ADC_CFGR2 |= ADC_CFGR2_PCLK2 ;          /* 01 PCLK/2 Over default 00 */
 #else
-    ADC_CFGR2 |= ADC_CFGR2_PCLK4 ;          /* 10 PCLK/4 Over default 00 */
+/* Select PCLK/2 or PCLK/4 as sampling clock for ADC, at current SYSCLK */
+    ADC_CFGR2 |= adc_ckmode( clock_hz) ;    /* Over default 00 */
 #endif
 
 /* Calibration */
@@ -330,7 +568,10 @@ void adc_vnt( vnt_cmd_t cmd, short *ptrV, short *ptrC) {
 }
 
 
-int init( void) {
+/* Clock setup, called at reset before memory initialization: no use of
+** static data. Reset_Handler then initializes memory at full speed.
+*/
+void clock_init( void) {
 /* By default SYSCLK == HSI [8MHZ] */
 
 #ifdef HSE
@@ -338,22 +579,26 @@ int init( void) {
     RCC_CR |= RCC_CR_HSEON ;
 /* Wait for oscillator to stabilize */
     do {} while( (RCC_CR & RCC_CR_HSERDY) == 0) ;
+    boot_mark( BOOT_HSE) ;
 #endif
 
 #ifdef PLL
-/* Setup PLL HSx/2 * 6 [24MHz] */
+/* Setup PLL HSI/2 or HSE/HSEPRE * PLL [CLOCK] */
     /* Default 0: PLL HSI/2 src, PLL MULL * 2 */
 # ifdef HSE
-    RCC_CFGR  = RCC_CFGR_PLLSRC_HSE | RCC_CFGR_PLLXTPRE_DIV2 |
-                RCC_CFGR_PLLMUL( PLL) ;
-#  ifdef HSEPRE
-    RCC_CFGR2 = HSEPRE - 1 ;
-#  endif
+    RCC_CFGR  = RCC_CFGR_PLLSRC_HSE | RCC_CFGR_PLLMUL( PLL) ;
+    RCC_CFGR2 = HSEPRE - 1 ;        /* PREDIV[0] is also PLLXTPRE */
 # else
     RCC_CFGR =  RCC_CFGR_PLLMUL( PLL) ;
 # endif
     RCC_CR |= RCC_CR_PLLON ;
     do {} while( (RCC_CR & RCC_CR_PLLRDY) == 0) ;   /* Wait for PLL */
+    boot_mark( BOOT_PLL) ;
+
+# if CLOCK > 24000000
+/* One flash wait state above 24MHz, prefetch buffer is enabled at reset */
+    FLASH_ACR |= FLASH_ACR_LATENCY ;
+# endif
 
 /* Switch to PLL as system clock SYSCLK == PLL [24MHz] */
     RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_SW_MSK) | RCC_CFGR_SW_PLL ;
@@ -368,17 +613,291 @@ int init( void) {
 /* Switch off HSI */
     RCC_CR &= ~RCC_CR_HSION ;
 #endif
+}
 
-/* SYSTICK */
-    SYSTICK_RVR = CLOCK / TICKDIV - 1 ;   /* HCLK / [8,1] */
-    SYSTICK_CVR = 0 ;
-#if TICKDIV == 8
-    SYSTICK_CSR = 3 ;               /* HCLK / 8, Interrupt ON, Enable */
+/* PLL setting for hz, pre 0 when hz is BASECLK, returns -1 if not possible */
+static int clock_solve( unsigned hz, unsigned *pre, unsigned *mul) {
+    *pre = 0 ;
+    if( hz == BASECLK)
+        return 0 ;
+
+    if( hz < 16000000 || hz > 48000000)
+        return -1 ;
+
+#ifdef HSE
+    for( *pre = 1 ; *pre <= 16 ; *pre += 1)
+        if( HSE % *pre == 0 && hz % (HSE / *pre) == 0) {
+            *mul = hz / (HSE / *pre) ;
+            if( *mul >= 2 && *mul <= 16)
+                return 0 ;
+        }
+
+    return -1 ;
 #else
-    SYSTICK_CSR = 7 ;               /* HCLK, Interrupt ON, Enable */
+    *pre = 2 ;          /* HSI / 2 */
+    *mul = hz / 4000000 ;
+    return (hz % 4000000 || *mul > 16) ? -1 : 0 ;
 #endif
-    /* SysTick_Handler will execute every 1s from now on */
+}
 
+/* SYSCLK to BASECLK then PLL if pre != 0, flash wait state already set */
+static void clock_switch( unsigned pre, unsigned mul) {
+/* Back to BASECLK then PLL off, it can only be configured when disabled */
+#ifdef HSE
+    RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_SW_MSK) | RCC_CFGR_SW_HSE ;
+    do {} while( (RCC_CFGR & RCC_CFGR_SWS_MSK) != RCC_CFGR_SWS_HSE) ;
+#else
+    RCC_CFGR &= ~RCC_CFGR_SW_MSK ;
+    do {} while( (RCC_CFGR & RCC_CFGR_SWS_MSK) != 0) ;
+#endif
+    RCC_CR &= ~RCC_CR_PLLON ;
+    do {} while( RCC_CR & RCC_CR_PLLRDY) ;
+
+    if( pre) {
+        RCC_CFGR = (RCC_CFGR & ~(RCC_CFGR_PLLSRC | RCC_CFGR_PLLMUL_MSK))
+#ifdef HSE
+                 | RCC_CFGR_PLLSRC_HSE
+#endif
+                 | RCC_CFGR_PLLMUL( mul) ;
+#ifdef HSE
+        RCC_CFGR2 = pre - 1 ;       /* PREDIV[0] is also PLLXTPRE */
+#endif
+        RCC_CR |= RCC_CR_PLLON ;
+        do {} while( (RCC_CR & RCC_CR_PLLRDY) == 0) ;   /* Wait for PLL */
+        RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_SW_MSK) | RCC_CFGR_SW_PLL ;
+        do {} while( (RCC_CFGR & RCC_CFGR_SWS_MSK) != RCC_CFGR_SWS_PLL) ;
+    }
+}
+
+/* Runtime SYSCLK switch: BASECLK (HSI or HSE) or PLL [16..48MHz], returns 0
+** on success, -1 if hz can't be generated. Flash wait state, USART1 baud
+** rate, SysTick period, usleep() scale and ADC clock mode are updated. The
+** SysTick period in progress when switching is stretched or shortened.
+*/
+int clock_set( unsigned hz) {
+    unsigned pre ;      /* PLL predivider, 0 when no PLL */
+    unsigned mul ;      /* PLL multiplier */
+
+    if( hz == clock_hz)
+        return 0 ;
+
+    if( clock_solve( hz, &pre, &mul))
+        return -1 ;
+
+/* Let pending transmission complete at current baud rate */
+    while( txbufout != txbufin)
+        yield() ;
+
+    do {} while( !(USART1[ ISR] & USART_ISR_TC)) ;
+
+/* Wait state and ADC clock valid at both frequencies while switching */
+    if( hz > 24000000)
+        FLASH_ACR |= FLASH_ACR_LATENCY ;
+
+#if ADCCKMODE != 0
+    adc_clock( hz > clock_hz ? hz : clock_hz) ;
+#endif
+
+/* Cycles at the old rate added to the base, handlers calling now_cycles()
+** wait until it is rebased, cycles while switching are not counted */
+    __asm( "CPSID i") ;
+    cycle_base = now_cycles64() ;
+    clock_switch( pre, mul) ;
+    if( hz <= 24000000)
+        FLASH_ACR &= ~FLASH_ACR_LATENCY ;
+
+#if ADCCKMODE != 0
+    adc_clock( hz) ;
+#endif
+    clock_hz = hz ;
+
+/* USART1 BRR can only be written when USART is disabled */
+    USART1[ CR1] &= ~USART_CR1_UE ;
+    USART1[ BRR] = (hz + BAUD / 2) / BAUD ;
+    USART1[ CR1] |= USART_CR1_UE ;
+
+/* SysTick: same TICK rate, new reload value used from next period */
+    if( hz / TICK > 0x1000000) {
+        SYSTICK_RVR = hz / 8 / TICK - 1 ;
+        SYSTICK_CSR = 3 ;           /* HCLK / 8, Interrupt ON, Enable */
+        tickus = hz / 8 / 1000000 ;
+    } else {
+        SYSTICK_RVR = hz / TICK - 1 ;
+        SYSTICK_CSR = 7 ;           /* HCLK, Interrupt ON, Enable */
+        tickus = hz / 1000000 ;
+    }
+
+    base_ticks = now_sample( &base_counts) ;    /* counts at new reload */
+    __asm( "CPSIE i") ;
+    return 0 ;
+}
+
+unsigned clock_get( void) {         /* current SYSCLK frequency */
+    return clock_hz ;
+}
+
+
+/** Idle manager **************************************************************/
+/* yield() selects the deepest idle state compatible with pending activity:
+** - Sleep while USART1 transmits, each interrupt returns to thread mode,
+** - Stop (IDLESTOP) when nothing is pending and next tick is far enough, the
+**   RTC alarm clocked by LSI wakes up every second and replaces SysTick,
+** - otherwise Sleep-on-exit, back to thread mode on SysTick due work, posted
+**   event, TIM16 release or USART1 transmit buffer drained.
+*/
+static unsigned long long idle_us[ IDLE_STATES] ;   /* residency */
+
+#ifdef IDLESTOP
+# if TICK != 1
+#  error IDLESTOP requires a 1 Hz tick
+# endif
+
+static void rtc_init( void) {       /* RTC alarm every second on LSI */
+    RCC_APB1ENR |= RCC_APB1ENR_PWREN ;
+    PWR_CR |= PWR_CR_DBP ;                  /* Backup domain write access */
+    RCC_CSR |= RCC_CSR_LSION ;
+    do {} while( !(RCC_CSR & RCC_CSR_LSIRDY)) ;
+    if( (RCC_BDCR & (RCC_BDCR_RTCSEL | RCC_BDCR_RTCEN))
+    != (RCC_BDCR_RTCSEL_LSI | RCC_BDCR_RTCEN)) {
+        RCC_BDCR |= RCC_BDCR_BDRST ;        /* RTCSEL can be set only once */
+        RCC_BDCR &= ~RCC_BDCR_BDRST ;
+        RCC_BDCR |= RCC_BDCR_RTCSEL_LSI | RCC_BDCR_RTCEN ;
+    }
+
+    RTC_WPR = 0xCA ;                        /* Unlock RTC registers */
+    RTC_WPR = 0x53 ;
+    RTC_ISR |= RTC_ISR_INIT ;
+    do {} while( !(RTC_ISR & RTC_ISR_INITF)) ;
+    RTC_PRER = LSI / 128 - 1 ;              /* 1Hz: two separate writes */
+    RTC_PRER |= 127 << 16 ;
+    RTC_ISR &= ~RTC_ISR_INIT ;
+
+    RTC_CR &= ~RTC_CR_ALRAE ;
+    do {} while( !(RTC_ISR & RTC_ISR_ALRAWF)) ;
+    RTC_ALRMAR = RTC_ALRMAR_MSKALL ;        /* every second */
+    RTC_CR |= RTC_CR_ALRAE | RTC_CR_ALRAIE ;
+    RTC_WPR = 0xFF ;                        /* Lock RTC registers */
+
+/* Alarm A on EXTI line 17 as wake up event */
+    EXTI_EMR |= EXTI_RTCALARM ;
+    EXTI_RTSR |= EXTI_RTCALARM ;
+}
+
+static void idle_stop( void) {
+    static int rtc_ready ;
+    unsigned pre, mul ;
+
+    if( !rtc_ready) {
+        rtc_init() ;
+        rtc_ready = 1 ;
+    }
+
+    SYSTICK_CSR &= ~1 ;                     /* SysTick stops with HCLK */
+    RTC_ISR &= ~RTC_ISR_ALRAF ;             /* not write protected */
+    EXTI_PR = EXTI_RTCALARM ;
+    PWR_CR = (PWR_CR & ~PWR_CR_PDDS) | PWR_CR_LPDS ;
+    SCB_SCR |= SCB_SCR_SLEEPDEEP ;
+    __asm( "SEV") ;                         /* clear event register */
+    __asm( "WFE") ;
+    __asm( "WFE") ;                         /* Stop until RTC alarm */
+    SCB_SCR &= ~SCB_SCR_SLEEPDEEP ;
+
+/* Wake up on HSI, restore SYSCLK, wait state is unchanged */
+# ifdef HSE
+    RCC_CR |= RCC_CR_HSEON ;
+    do {} while( (RCC_CR & RCC_CR_HSERDY) == 0) ;
+# endif
+    clock_solve( clock_hz, &pre, &mul) ;
+    clock_switch( pre, mul) ;
+# ifdef HSE
+    RCC_CR &= ~RCC_CR_HSION ;
+# endif
+
+/* Tick on RTC alarm, SysTick restarts a full period from now */
+    SYSTICK_CVR = 0 ;
+    SYSTICK_CSR |= 1 ;
+    if( RTC_ISR & RTC_ISR_ALRAF) {
+        __asm( "CPSID i") ;     /* as a handler, for event_post() */
+        SysTick_Handler() ;
+        __asm( "CPSIE i") ;
+    }
+}
+#endif
+
+void yield( void) {             /* give way */
+    idle_t state ;
+    unsigned start ;
+
+    wakeup = 0 ;
+    if( event_dispatch && event_dispatch())
+        return ;                /* events dispatched, no wait */
+
+    if( timer_run && timer_run())
+        return ;                /* timers expired, no wait */
+
+    if( task_yield && task_yield())
+        return ;                /* other tasks ran, no wait */
+
+#ifdef CRC32IDLE
+    if( flash_status == 0) {    /* flash check in progress, no wait */
+        check_flash_slice() ;
+        return ;
+    }
+
+#endif
+    if( txbufout != txbufin || !(USART1[ ISR] & USART_ISR_TC)
+    ||  usleep_busy)
+        state = IDLE_SLEEP ;
+#ifdef IDLESTOP
+    else if( SYSTICK_CVR / tickus >= IDLESTOP_MIN)
+        state = IDLE_STOP ;
+#endif
+    else
+        state = IDLE_SLEEPONEXIT ;
+
+#ifdef IDLESTOP
+    if( state == IDLE_STOP) {
+        start = SYSTICK_CVR ;   /* time left before tick */
+        idle_stop() ;
+        idle_us[ IDLE_STOP] += start / tickus ;     /* estimate */
+        return ;
+    }
+
+#endif
+/* Interrupts masked from wakeup test to WFI, a tick can't slip in between,
+** the pending interrupt is serviced once unmasked */
+    start = now_us() ;
+    __asm( "CPSID i") ;
+    if( !wakeup && !(event_pending && event_pending())) {
+        if( state == IDLE_SLEEPONEXIT)
+            SCB_SCR |= SCB_SCR_SLEEPONEXIT ;    /* cleared by handlers */
+
+        __asm( "WFI") ; /* Wait for Interrupt */
+    }
+
+    __asm( "CPSIE i") ;
+    idle_us[ state] += now_us() - start ;
+}
+
+unsigned idle_residency( idle_t state) {    /* per mille of uptime */
+    unsigned long long total = uptime * 1000000ULL ;
+    unsigned long long us ;
+
+    if( total == 0)
+        return 0 ;
+
+    if( state != IDLE_RUN)
+        us = idle_us[ state] ;
+    else {
+        us = total ;
+        for( int i = IDLE_RUN + 1 ; i < IDLE_STATES ; i++)
+            us -= us > idle_us[ i] ? idle_us[ i] : us ;
+    }
+
+    return us * 1000 / total ;
+}
+
+int init( void) {
 #ifdef LED_ON
 /* User LED ON */
     RCC_AHBENR |= RCC_AHBENR_IOPh( LED_IOP) ;       /* Enable IOPx periph */
@@ -396,12 +915,28 @@ int init( void) {
     GPIOA[ MODER] |= 0x0A << (9 * 2) ;  /* PA9-10 ALT 10, over default 00 */
     GPIOA[ AFRH] |= 0x110 ;             /* PA9-10 AF1 0001, over default 0000 */
     RCC_APB2ENR |= RCC_APB2ENR_USART1EN ;
-    USART1[ BRR] = CLOCK / BAUD ;       /* PCLK is default source */
+    USART1[ BRR] = USARTDIV ;           /* PCLK is default source */
     USART1[ CR1] |= USART_CR1_UE | USART_CR1_TE ;   /* Enable USART & Tx */
 
 /* Unmask USART1 irq */
     unmask_irq( USART1_IRQ_IDX) ;
 
+    boot_mark( BOOT_USART) ;     /* before SysTick is set for uptime */
+
+/* TIM16 one-shot for usleep() */
+    RCC_APB2ENR |= RCC_APB2ENR_TIM16EN ;
+    unmask_irq( TIM16_IRQ_IDX) ;
+
+/* SYSTICK */
+    SYSTICK_RVR = TICKRVR ;         /* HCLK / [8,1] */
+    SYSTICK_CVR = 0 ;
+#if TICKDIV == 8
+    SYSTICK_CSR = 3 ;               /* HCLK / 8, Interrupt ON, Enable */
+#else
+    SYSTICK_CSR = 7 ;               /* HCLK, Interrupt ON, Enable */
+#endif
+    /* SysTick_Handler will execute TICK times per second from now on */
+
     kputs(
 #ifdef PLL
         "PLL"
@@ -413,6 +948,9 @@ int init( void) {
 #endif
         "\n") ;
 
+#ifdef BOOTPROF
+    boot_report( CLOCK) ;
+#endif
     return 0 ;
 }
 
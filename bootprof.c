@@ -0,0 +1,37 @@
+/* bootprof.c -- BOOTPROF: boot duration report, called by init() */
+/* Copyright (c) 2025 Renaud Fivet */
+
+#include "system.h" /* implements system.h boot_report() */
+
+#ifdef BOOTPROF
+
+static void kputu( unsigned u) {     /* unsigned decimal output */
+    if( u >= 10)
+        kputu( u / 10) ;
+
+    kputc( '0' + u % 10) ;
+}
+
+void boot_report( unsigned hz) {    /* hz: HCLK after clock_init() */
+    static const char *const phases[ BOOT_PHASES] = {
+        "HSE", "PLL", "copy", "zero", "remap", "crc", "usart"
+    } ;
+
+/* Memory initialization duration, at full speed */
+    kputs( "boot: ") ;
+    kputu( boot_cycles) ;
+    kputs( " cycles, ") ;
+    kputu( boot_cycles / (hz / 1000000)) ;
+    kputs( " us\n") ;
+
+/* Boot phases, HSE and PLL lock wait run at HSI 8MHz */
+    for( int i = 0 ; i < BOOT_PHASES ; i++) {
+        kputs( phases[ i]) ;
+        kputs( ": ") ;
+        kputu( boot_prof[ i] / (i <= BOOT_PLL ? 8 : hz / 1000000)) ;
+        kputs( " us\n") ;
+    }
+}
+#endif
+
+/* end of bootprof.c */
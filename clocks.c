@@ -11,6 +11,10 @@
 
 #include "system.h" /* implements system.h */
 
+#ifdef CRC32IDLE
+# error CRC32IDLE: no background flash check in this system layer
+#endif
+
 #define SYSTICK                 ((volatile long *) 0xE000E010)
 #define SYSTICK_CSR             SYSTICK[ 0]
 #define SYSTICK_RVR             SYSTICK[ 1]
@@ -49,6 +53,8 @@
 #define RCC_APB2ENR             RCC[ 6]
 #define RCC_APB2ENR_USART1EN    0x00004000  /* 14: USART1 clock enable */
 
+#define RCC_CFGR2               RCC[ 11]    /* 3-0: PLL PREDIV */
+
 #define GPIOA                   ((volatile long *) 0x48000000)
 #define GPIOB                   ((volatile long *) 0x48000400)
 #define GPIO( x) CAT( GPIO, x)
@@ -72,33 +78,10 @@
 #define LED_ON  0
 /* 8MHz quartz, configure PLL at 24MHz */
 #define HSE     8000000
-#define PLL     6
+#define SYSCLK  24000000
 #define BAUD    9600
 
-#ifdef PLL
-# ifdef HSE
-#  define CLOCK HSE / 2 * PLL
-# else /* HSI */
-#  define CLOCK 8000000 / 2 * PLL
-# endif
-# if CLOCK < 16000000
-# error PLL output below 16MHz
-# endif
-#else
-# ifdef HSE
-#  define CLOCK HSE
-# else /* HSI */
-#  define CLOCK 8000000
-# endif
-#endif
-
-#if CLOCK > 48000000
-# error clock frequency exceeds 48MHz
-#endif
-
-#if CLOCK % BAUD
-# warning baud rate not accurate at that clock frequency
-#endif
+#include "clocktree.h"  /* CLOCK, PLL, HSEPRE, USARTDIV, TICKDIV, TICKRVR */
 
 void kputc( unsigned char c) {  /* character output */
     static unsigned char lastc ;
@@ -126,6 +109,12 @@ int kputs( const char s[]) {    /* string output */
 }
 
 void yield( void) {             /* give way */
+    if( timer_run && timer_run())
+        return ;                /* timers expired, no wait */
+
+    if( task_yield && task_yield())
+        return ;                /* other tasks ran, no wait */
+
     __asm( "WFI") ; /* Wait for System Tick Interrupt */
 }
 
@@ -138,6 +127,9 @@ static void userLEDtoggle( void) {
 #endif
 
 void SysTick_Handler( void) {
+    if( timer_tick)
+        timer_tick( 1000) ;     /* 1s tick */
+
     uptime += 1 ;
 #ifdef LED_ON
     userLEDtoggle() ;
@@ -155,10 +147,11 @@ int init( void) {
 #endif
 
 #ifdef PLL
-/* Setup PLL HSx/2 * 6 [24MHz] */
+/* Setup PLL HSI/2 or HSE/HSEPRE * PLL [CLOCK] */
     /* Default 0: PLL HSI/2 src, PLL MULL * 2 */
 # ifdef HSE
-    RCC_CFGR = RCC_CFGR_PLLSRC_HSE | RCC_CFGR_PLLXTPRE_DIV2 ;
+    RCC_CFGR = RCC_CFGR_PLLSRC_HSE ;
+    RCC_CFGR2 = HSEPRE - 1 ;        /* PREDIV[0] is also PLLXTPRE */
 # endif
     RCC_CFGR |= RCC_CFGR_PLLMUL( PLL) ;
     RCC_CR |= RCC_CR_PLLON ;
@@ -181,9 +174,13 @@ int init( void) {
 #endif
 
 /* SYSTICK */
-    SYSTICK_RVR = CLOCK / 8 - 1 ;   /* HBA / 8 */
+    SYSTICK_RVR = TICKRVR ;         /* HCLK / [8,1] */
     SYSTICK_CVR = 0 ;
-    SYSTICK_CSR = 3 ;               /* HBA / 8, Interrupt ON, Enable */
+#if TICKDIV == 8
+    SYSTICK_CSR = 3 ;               /* HCLK / 8, Interrupt ON, Enable */
+#else
+    SYSTICK_CSR = 7 ;               /* HCLK, Interrupt ON, Enable */
+#endif
     /* SysTick_Handler will execute every 1s from now on */
 
 #ifdef LED_ON
@@ -203,7 +200,7 @@ int init( void) {
     GPIOA[ MODER] |= 0x0A << (9 * 2) ;  /* PA9-10 ALT 10, over default 00 */
     GPIOA[ AFRH] |= 0x110 ;             /* PA9-10 AF1 0001, over default 0000 */
     RCC_APB2ENR |= RCC_APB2ENR_USART1EN ;
-    USART1[ BRR] = CLOCK / BAUD ;       /* PCLK is default source */
+    USART1[ BRR] = USARTDIV ;           /* PCLK is default source */
     USART1[ CR1] |= USART_CR1_UE | USART_CR1_TE ;   /* Enable USART & Tx */
 
     kputs(
@@ -0,0 +1,171 @@
+/* clocktree.h -- STM32F030 compile time clock tree solver  */
+/* Copyright (c) 2025 Renaud Fivet                          */
+
+/* Input, defined before inclusion:
+**  SYSCLK      target system clock frequency in Hz, default 8MHz (HSI)
+**  HSE         external oscillator frequency in Hz, if any
+**  BAUD        USART1 baud rate
+**  TICK        SysTick interrupt rate in Hz, default 1
+**  BAUD_TOL    baud rate error budget in ppm, default 10000 (1%)
+**  TICK_TOL    SysTick period error budget in ppm, default 100
+**  USLEEP_TOL  usleep() error budget in ppm, default 50000 (5%)
+**  HSI14       ADC sampling clock forced to HSI14
+**
+** Output:
+**  CLOCK       resulting SYSCLK == HCLK == PCLK
+**  PLL         PLL multiplier 2..16, when PLL is used
+**  HSEPRE      HSE PLL predivider 1..16, when PLL is used with HSE
+**  USARTDIV    USART1 BRR value
+**  TICKDIV     SysTick clock source HCLK / [8,1]
+**  TICKRVR     SysTick reload value
+**  TICKUS      SysTick counts per microsecond, for usleep()
+**  ADCCKMODE   ADC_CFGR2 CKMODE: 0 HSI14, 1 PCLK/2, 2 PCLK/4
+**  BAUD_PPM, TICK_PPM, USLEEP_PPM  resulting errors
+*/
+
+#ifndef SYSCLK
+# ifdef HSE
+#  define SYSCLK    HSE
+# else
+#  define SYSCLK    8000000
+# endif
+#endif
+
+#ifndef TICK
+# define TICK       1
+#endif
+
+#ifndef BAUD_TOL
+# define BAUD_TOL   10000
+#endif
+
+#ifndef TICK_TOL
+# define TICK_TOL   100
+#endif
+
+#ifndef USLEEP_TOL
+# define USLEEP_TOL 50000
+#endif
+
+#if SYSCLK > 48000000
+# error clock frequency exceeds 48MHz
+#endif
+
+/** SYSCLK source: HSI, HSE, PLL HSI/2, PLL HSE/HSEPRE ************************/
+
+#ifdef HSE
+# if SYSCLK == HSE
+#  define CLOCK     HSE
+# else
+/* smallest predivider giving an integer multiplier in range */
+#  define CT_MUL( p)    (SYSCLK / (HSE / (p)))
+#  define CT_FIT( p)    (HSE % (p) == 0 && SYSCLK % (HSE / (p)) == 0 \
+                        && CT_MUL( p) >= 2 && CT_MUL( p) <= 16)
+#  if   CT_FIT( 1)
+#   define HSEPRE   1
+#  elif CT_FIT( 2)
+#   define HSEPRE   2
+#  elif CT_FIT( 3)
+#   define HSEPRE   3
+#  elif CT_FIT( 4)
+#   define HSEPRE   4
+#  elif CT_FIT( 5)
+#   define HSEPRE   5
+#  elif CT_FIT( 6)
+#   define HSEPRE   6
+#  elif CT_FIT( 7)
+#   define HSEPRE   7
+#  elif CT_FIT( 8)
+#   define HSEPRE   8
+#  elif CT_FIT( 9)
+#   define HSEPRE   9
+#  elif CT_FIT( 10)
+#   define HSEPRE   10
+#  elif CT_FIT( 11)
+#   define HSEPRE   11
+#  elif CT_FIT( 12)
+#   define HSEPRE   12
+#  elif CT_FIT( 13)
+#   define HSEPRE   13
+#  elif CT_FIT( 14)
+#   define HSEPRE   14
+#  elif CT_FIT( 15)
+#   define HSEPRE   15
+#  elif CT_FIT( 16)
+#   define HSEPRE   16
+#  else
+#   error no PLL setting for SYSCLK from HSE
+#   define HSEPRE   1
+#  endif
+#  define PLL       CT_MUL( HSEPRE)
+#  define CLOCK     (HSE / HSEPRE * PLL)
+# endif
+#elif SYSCLK == 8000000
+# define CLOCK      8000000
+#elif SYSCLK % 4000000 == 0 && SYSCLK / 4000000 >= 2
+# define PLL        (SYSCLK / 4000000)
+# define CLOCK      (8000000 / 2 * PLL)
+#else
+# error no PLL setting for SYSCLK from HSI
+# define CLOCK      SYSCLK
+#endif
+
+#if defined( PLL) && CLOCK < 16000000
+# error PLL output below 16MHz
+#endif
+
+/** USART1 baud rate, oversampling by 16 **************************************/
+
+#ifdef BAUD
+# define USARTDIV   ((CLOCK + BAUD / 2) / BAUD)
+# if USARTDIV < 16 || USARTDIV > 0xFFFF
+#  error baud rate out of range at that clock frequency
+# endif
+# define CT_BAUDCLK (USARTDIV * BAUD)
+# define BAUD_PPM   ((CLOCK > CT_BAUDCLK ? CLOCK - CT_BAUDCLK \
+                                         : CT_BAUDCLK - CLOCK) \
+                    * 1000000LL / CT_BAUDCLK)
+# if BAUD_PPM > BAUD_TOL
+#  error baud rate error over budget at that clock frequency
+# endif
+#endif
+
+/** SysTick: period and usleep() resolution ***********************************/
+
+#if CLOCK / TICK > 0x1000000
+# define TICKDIV    8
+#else
+# define TICKDIV    1
+#endif
+
+#if CLOCK / TICKDIV / TICK > 0x1000000 || CLOCK / TICKDIV / TICK == 0
+# error SysTick rate out of range at that clock frequency
+#endif
+
+#define TICKRVR     (CLOCK / TICKDIV / TICK - 1)
+#define TICK_PPM    (CLOCK % (TICKDIV * TICK) * 1000000LL / CLOCK)
+#if TICK_PPM > TICK_TOL
+# error SysTick period error over budget at that clock frequency
+#endif
+
+#define TICKUS      (CLOCK / TICKDIV / 1000000)
+#if TICKUS == 0
+# error usleep() resolution below 1us at that clock frequency
+#endif
+
+#define USLEEP_PPM  (CLOCK % (TICKDIV * 1000000) * 1000000LL / CLOCK)
+#if USLEEP_PPM > USLEEP_TOL
+# error usleep() error over budget at that clock frequency
+#endif
+
+/** ADC sampling clock, 14MHz max *********************************************/
+
+#if defined( HSI14) || CLOCK / 4 > 14000000
+# define ADCCKMODE  0
+#elif CLOCK / 2 > 14000000
+# define ADCCKMODE  2
+#else
+# define ADCCKMODE  1
+#endif
+
+/* end of clocktree.h */
@@ -4,6 +4,56 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+/*
+**  On unix hosts, option -j[N] splits calculation between N threads, all
+**  cores when N is omitted. Partial crcs are merged using crc combination.
+*/
+#if defined( __unix__) && !defined( GENTABLE)
+# define PARALLEL
+# include <pthread.h>
+#endif
+
+/*
+**  On unix hosts, option -m maps the input in memory and writes the output
+**  in one copy (or as a clone of the input where the file system supports
+**  it), option -i signs in place an input ending with DEADC0DE placeholder.
+*/
+#if defined( __unix__) && !defined( GENTABLE)
+# define MMAP
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# ifdef __linux__
+#  include <sys/ioctl.h>
+#  include <linux/fs.h>         /* FICLONE */
+# endif
+#endif
+
+/*
+**  define BENCH to build a benchmark of the selected calculation variant
+*/
+#ifdef BENCH
+# include <time.h>
+# if defined( __x86_64__) || defined( __i386__)
+#  define RDTSC
+#  include <x86intrin.h>
+# endif
+#endif
+
+/*
+**  On x86-64 hosts, calculation uses carry-less multiplication folding when
+**  the CPU supports PCLMULQDQ, falling back to table calculation otherwise.
+**  define NOCLMUL to always use table calculation
+*/
+#if !defined( BITWISE) && !defined( NOCLMUL) && !defined( GENTABLE) \
+ && defined( __x86_64__) && defined( __GNUC__)
+# define CLMUL
+# include <immintrin.h>
+#endif
 
 /*
 **  POLY32 is 0x04C11DB7
@@ -20,6 +70,7 @@
 **  define BITWISE if you want calculation made by bit otherwise by byte
 **  when BITWISE, define UNROLL to speed up things a bit
 **  define GENTABLE to printout bytewise calculation table
+**  define SLICE as 8 or 16 to calculate by 8 or 16 bytes using slicing tables
 **
 **  GENTABLE + BITWISE          print bytewise table using bitwise calculation
 **  GENTABLE + BITWISE + UNROLL print bytewise table using unrolled bitwise table calculation
@@ -27,12 +78,14 @@
 **  BITWISE                     binary sign using bitwise calculation
 **  BITWISE + UNROLL            binary sign using unrolled bitwise table calculation
 **  nothing defined             binary sign using bytewise table calculation
+**  SLICE=8                     binary sign using slicing-by-8 table calculation
+**  SLICE=16                    binary sign using slicing-by-16 table calculation
 */
 
-#ifdef BITWISE
-
 #define POLY32 0x04C11DB7
 
+#ifdef BITWISE
+
 static uint32_t crc32( uint32_t crc, unsigned char c) {
 #ifndef UNROLL
     int i ;
@@ -131,6 +184,29 @@ static const uint32_t crc32tab[ 256] = {
     0xAFB010B1, 0xAB710D06, 0xA6322BDF, 0xA2F33668,
     0xBCB4666D, 0xB8757BDA, 0xB5365D03, 0xB1F740B4
 } ;
+
+#ifdef SLICE
+# if SLICE != 8 && SLICE != 16
+#  error SLICE must be 8 or 16
+# endif
+
+/* slicetab[ k][ b] is crc of byte b followed by k zero bytes */
+static uint32_t slicetab[ SLICE][ 256] ;
+
+static void init_slices( void) {
+    int i, k ;
+
+    for( i = 0 ; i < 256 ; i++) {
+        uint32_t crc = crc32tab[ i] ;
+
+        slicetab[ 0][ i] = crc ;
+        for( k = 1 ; k < SLICE ; k++) {
+            crc = crc32( crc, 0) ;
+            slicetab[ k][ i] = crc ;
+        }
+    }
+}
+#endif
 #endif
 
 #ifdef GENTABLE
@@ -152,7 +228,7 @@ int main() {
 }
 #else
 
-static uint32_t check_word( uint32_t crc, unsigned char buf[ 4]) {
+static uint32_t check_word( uint32_t crc, const unsigned char buf[ 4]) {
     crc = crc32( crc, buf[ 3]) ;
     crc = crc32( crc, buf[ 2]) ;
     crc = crc32( crc, buf[ 1]) ;
@@ -161,77 +237,1337 @@ static uint32_t check_word( uint32_t crc, unsigned char buf[ 4]) {
     return crc ;
 }
 
+#ifdef SLICE
+static uint32_t le32( const unsigned char *p) {
+    return p[ 0] | p[ 1] << 8 | (uint32_t) p[ 2] << 16
+                                                    | (uint32_t) p[ 3] << 24 ;
+}
+
+# define slice( k, w) \
+    slicetab[ k + 3][ w >> 24] ^ slicetab[ k + 2][ (w >> 16) & 0xFF] ^ \
+    slicetab[ k + 1][ (w >> 8) & 0xFF] ^ slicetab[ k][ w & 0xFF]
+#endif
+
+/* a * b modulo POLY32 */
+static uint32_t mulmod( uint32_t a, uint32_t b) {
+    uint32_t r = 0 ;
+    uint32_t bit ;
+
+    for( bit = 0x80000000 ; bit ; bit >>= 1) {
+        r = (r << 1) ^ ((r & 0x80000000) ? POLY32 : 0) ;
+        if( a & bit)
+            r ^= b ;
+    }
+
+    return r ;
+}
+
+/* x^n modulo POLY32 */
+static uint32_t xpow( uint64_t n) {
+    uint32_t r = 1 ;            /* x^0 */
+    uint32_t sq = 2 ;           /* x^1, x^2, x^4, x^8, ... */
+
+    for( ; n ; n >>= 1) {
+        if( n & 1)
+            r = mulmod( r, sq) ;
+
+        sq = mulmod( sq, sq) ;
+    }
+
+    return r ;
+}
+
+#ifdef CLMUL
+static int clmul ;              /* CPU supports PCLMULQDQ */
+static long long k512[ 2] ;     /* x^512, x^576 mod POLY32 */
+static long long k128[ 2] ;     /* x^128, x^192 mod POLY32 */
+
+static void init_clmul( void) {
+    clmul = __builtin_cpu_supports( "pclmul") ;
+    k512[ 0] = xpow( 512) ;
+    k512[ 1] = xpow( 512 + 64) ;
+    k128[ 0] = xpow( 128) ;
+    k128[ 1] = xpow( 128 + 64) ;
+}
+
+/* load 4 words as a 128 bit polynomial, first word as highest degree */
+# define load( p)    _mm_shuffle_epi32( \
+                        _mm_loadu_si128( (const __m128i *) (p)), 0x1B)
+/* x * x^T with k = { x^T, x^(T+64)} mod POLY32 */
+# define fold( x, k) _mm_xor_si128( _mm_clmulepi64_si128( x, k, 0x00), \
+                                    _mm_clmulepi64_si128( x, k, 0x11))
+
+/* crc of nwords 32 bit words by folding, nwords multiple of 16 */
+__attribute__((target("pclmul")))
+static uint32_t check_clmul( uint32_t crc, const unsigned char *p,
+                                                            size_t nwords) {
+    __m128i x0, x1, x2, x3, k ;
+    uint32_t x[ 4] ;
+
+/* four 128 bit accumulators, crc xored with first word */
+    x0 = load( p) ;
+    x0 = _mm_xor_si128( x0, _mm_set_epi32( crc, 0, 0, 0)) ;
+    x1 = load( p + 16) ;
+    x2 = load( p + 32) ;
+    x3 = load( p + 48) ;
+    p += 64 ;
+
+/* fold by 512 bits */
+    k = _mm_set_epi64x( k512[ 1], k512[ 0]) ;
+    for( nwords -= 16 ; nwords ; nwords -= 16) {
+        x0 = _mm_xor_si128( fold( x0, k), load( p)) ;
+        x1 = _mm_xor_si128( fold( x1, k), load( p + 16)) ;
+        x2 = _mm_xor_si128( fold( x2, k), load( p + 32)) ;
+        x3 = _mm_xor_si128( fold( x3, k), load( p + 48)) ;
+        p += 64 ;
+    }
+
+/* fold accumulators by 128 bits into one */
+    k = _mm_set_epi64x( k128[ 1], k128[ 0]) ;
+    x0 = _mm_xor_si128( fold( x0, k), x1) ;
+    x0 = _mm_xor_si128( fold( x0, k), x2) ;
+    x0 = _mm_xor_si128( fold( x0, k), x3) ;
+
+/* reduce remaining 128 bits through table calculation */
+    _mm_storeu_si128( (__m128i *) x, x0) ;
+    crc = check_word( 0, (const unsigned char *) &x[ 3]) ;
+    crc = check_word( crc, (const unsigned char *) &x[ 2]) ;
+    crc = check_word( crc, (const unsigned char *) &x[ 1]) ;
+    return check_word( crc, (const unsigned char *) &x[ 0]) ;
+}
+#endif
+
+/* crc of nwords 32 bit little endian words */
+static uint32_t check_block( uint32_t crc, const unsigned char *p,
+                                                            size_t nwords) {
+#ifdef CLMUL
+    if( clmul && nwords >= 32) {
+        size_t n = nwords & ~(size_t) 15 ;
+
+        crc = check_clmul( crc, p, n) ;
+        p += n * 4 ;
+        nwords -= n ;
+    }
+#endif
+
+#ifdef SLICE
+    for( ; nwords >= SLICE / 4 ; nwords -= SLICE / 4) {
+        uint32_t w0 = crc ^ le32( p) ;
+        uint32_t w1 = le32( p + 4) ;
+# if SLICE == 16
+        uint32_t w2 = le32( p + 8) ;
+        uint32_t w3 = le32( p + 12) ;
+
+        crc = slice( 12, w0) ^ slice( 8, w1) ^ slice( 4, w2) ^ slice( 0, w3) ;
+# else
+        crc = slice( 4, w0) ^ slice( 0, w1) ;
+# endif
+        p += SLICE ;
+    }
+#endif
+
+    while( nwords--) {
+        crc = check_word( crc, p) ;
+        p += 4 ;
+    }
+
+    return crc ;
+}
+
+
+#define BUFSIZE 0x10000         /* input buffer size, multiple of 4 */
+
+#ifdef PARALLEL
+# define MAXJOBS 64
+# define JOBSIZE 0x100000       /* input buffer size per job */
+
+static int jobs = 1 ;
+
+static struct job {
+    pthread_t       thread ;
+    const unsigned char *p ;
+    size_t          nwords ;
+    uint32_t        crc ;
+} jobtab[ MAXJOBS] ;
+
+static void *check_job( void *arg) {
+    struct job *jp = arg ;
+
+    jp->crc = check_block( jp->crc, jp->p, jp->nwords) ;
+    return NULL ;
+}
+
+/* crc of nwords split in chunks calculated in parallel then combined */
+static uint32_t check_parallel( uint32_t crc, const unsigned char *p,
+                                                            size_t nwords) {
+    int i, cnt ;
+    size_t chunk ;
+
+    cnt = jobs ;
+    chunk = nwords / cnt & ~(size_t) 15 ;
+    if( chunk < JOBSIZE / 16)   /* not worth spawning threads */
+        return check_block( crc, p, nwords) ;
+
+    for( i = 0 ; i < cnt ; i++) {
+        jobtab[ i].p = p ;
+        jobtab[ i].nwords = i == cnt - 1 ? nwords : chunk ;
+        jobtab[ i].crc = 0 ;
+        p += chunk * 4 ;
+        nwords -= chunk ;
+    }
+
+    jobtab[ 0].crc = crc ;
+    for( i = 1 ; i < cnt ; i++)
+        if( pthread_create( &jobtab[ i].thread, NULL, check_job, &jobtab[ i])) {
+            cnt = i ;           /* calculate the remaining chunks here */
+            break ;
+        }
+
+    check_job( &jobtab[ 0]) ;
+    crc = jobtab[ 0].crc ;
+    for( i = 1 ; i < jobs ; i++) {
+        if( i < cnt)
+            pthread_join( jobtab[ i].thread, NULL) ;
+        else
+            check_job( &jobtab[ i]) ;
+
+    /* crc( A + B) == crc( A) * x^|B| + crc0( B) */
+        crc = mulmod( crc, xpow( jobtab[ i].nwords * 32)) ^ jobtab[ i].crc ;
+    }
+
+    return crc ;
+}
+#else
+# define check_parallel check_block
+#endif
+
+#ifdef BENCH
+/*
+**  bench [-j[jobs]] [maxsize]
+**  time calculation over buffers of 1K to maxsize (default 1G) bytes and
+**  cross-check result against bitwise reference calculation
+*/
+
+static uint32_t check_ref( uint32_t crc, const unsigned char *p,
+                                                            size_t nwords) {
+    int i, j ;
+
+    while( nwords--) {
+        for( i = 3 ; i >= 0 ; i--) {
+            crc ^= (uint32_t) p[ i] << 24 ;
+            for( j = 8 ; j ; j--)
+                crc = (crc << 1) ^ ((crc & 0x80000000) ? POLY32 : 0) ;
+        }
+
+        p += 4 ;
+    }
+
+    return crc ;
+}
+
+static const char *variant( void) {
+    static char name[ 32] ;
+
+    snprintf( name, sizeof name, "%s%s",
+#if defined( BITWISE) && defined( UNROLL)
+        "bitwise+unroll",
+#elif defined( BITWISE)
+        "bitwise",
+#elif defined( SLICE) && SLICE == 16
+        "slice16",
+#elif defined( SLICE)
+        "slice8",
+#else
+        "table",
+#endif
+#ifdef CLMUL
+        clmul ? "+clmul" :
+#endif
+        "") ;
+#ifdef PARALLEL
+    if( jobs > 1)
+        snprintf( name + strlen( name), sizeof name - strlen( name), " -j%d",
+                                                                        jobs) ;
+#endif
+    return name ;
+}
+
+static const char *sizestr( size_t size) {
+    static char str[ 16] ;
+    const char *unit = "KMG" ;
+
+    for( size /= 1024 ; size >= 1024 && unit[ 1] ; size /= 1024)
+        unit += 1 ;
+
+    snprintf( str, sizeof str, "%zu%c", size, *unit) ;
+    return str ;
+}
+
+static double seconds( void) {
+    struct timespec ts ;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts) ;
+    return ts.tv_sec + ts.tv_nsec * 1e-9 ;
+}
+
+int main( int argc, char *argv[]) {
+    int c ;
+    int ret = EXIT_SUCCESS ;
+    size_t maxsize, size, done, reps, i ;
+    unsigned char *buf ;
+    uint32_t crc, ref, seed ;
+    double t ;
+#ifdef RDTSC
+    uint64_t cycles ;
+#endif
+
+    while( (c = getopt( argc, argv, "j::")) != -1)
+        switch( c) {
+#ifdef PARALLEL
+        case 'j':
+            jobs = optarg ? atoi( optarg) : sysconf( _SC_NPROCESSORS_ONLN) ;
+            if( jobs < 1)
+                jobs = 1 ;
+            else if( jobs > MAXJOBS)
+                jobs = MAXJOBS ;
+
+            break ;
+#endif
+        default:
+            fprintf( stderr, "usage: %s [-j[jobs]] [maxsize]\n", argv[ 0]) ;
+            return EXIT_FAILURE ;
+        }
+
+    maxsize = 1 << 30 ;
+    if( argv[ optind]) {
+        char *unit ;
+
+        maxsize = strtoul( argv[ optind], &unit, 0) ;
+        if( *unit == 'K')
+            maxsize <<= 10 ;
+        else if( *unit == 'M')
+            maxsize <<= 20 ;
+        else if( *unit == 'G')
+            maxsize <<= 30 ;
+    }
+
+#ifdef SLICE
+    init_slices() ;
+#endif
+#ifdef CLMUL
+    init_clmul() ;
+#endif
+    buf = malloc( maxsize) ;
+    if( !buf) {
+        perror( argv[ 0]) ;
+        return EXIT_FAILURE ;
+    }
+
+    seed = 0x2545F491 ;         /* xorshift32 pseudo random input */
+    for( i = 0 ; i < maxsize ; i++) {
+        seed ^= seed << 13 ;
+        seed ^= seed >> 17 ;
+        seed ^= seed << 5 ;
+        buf[ i] = seed ;
+    }
+
+    ref = 0xFFFFFFFF ;
+    done = 0 ;
+    for( size = 1024 ; size <= maxsize ; size *= 4) {
+    /* reference crc of buffer extended by bitwise calculation */
+        ref = check_ref( ref, &buf[ done], (size - done) / 4) ;
+        done = size ;
+
+    /* repeat calculation for at least 100ms */
+        for( reps = 1 ; ; reps *= 2) {
+            t = seconds() ;
+#ifdef RDTSC
+            cycles = __rdtsc() ;
+#endif
+            for( i = 0 ; i < reps ; i++)
+                crc = check_parallel( 0xFFFFFFFF, buf, size / 4) ;
+
+#ifdef RDTSC
+            cycles = __rdtsc() - cycles ;
+#endif
+            t = seconds() - t ;
+            if( t >= 0.1)
+                break ;
+        }
+
+        printf( "%-20s %6s %10.1f MB/s", variant(), sizestr( size),
+                                                    size * reps / t / 1e6) ;
+#ifdef RDTSC
+        printf( " %8.3f cycles/B", (double) cycles / size / reps) ;
+#endif
+        printf( " %s\n", crc == ref ? "ok" : "FAIL") ;
+        if( crc != ref)
+            ret = EXIT_FAILURE ;
+    }
+
+    free( buf) ;
+    return ret ;
+}
+#else
 
 static const unsigned mark = 0xDEC0ADDE ;	/* DEADC0DE placeholder value */
+static const char *outname = "signed.bin" ;    /* -o: signed binary output */
+static FILE *msg ;              /* summary, stderr when output to stdout */
+
+/*
+**  "-" as input or output name streams from stdin or to stdout, memory use
+**  is bounded by the block size whatever the stream length.
+*/
+static FILE *open_stream( const char *name, const char *mode) {
+    if( strcmp( name, "-"))
+        return fopen( name, mode) ;
+
+    return *mode == 'r' ? stdin : stdout ;
+}
+
+static int close_stream( FILE *f) {
+    if( f == stdin)
+        return 0 ;
+
+    return f == stdout ? fflush( f) : fclose( f) ;
+}
+
+/*
+**  -x: Intel HEX output of the signed image, 16 bytes per data record, an
+**  extended linear address record at each 64K boundary, start address
+**  record then end of file record, same as objcopy -O ihex.
+*/
+static const char *hexname ;
+static FILE *fhex ;
+static uint32_t hexaddr ;       /* address of next byte */
+static uint32_t hexentry ;      /* start address */
+static long hexseg ;            /* current upper 16 bits of address */
+static unsigned hexlen ;
+static unsigned char hexline[ 16] ;
+
+static void hex_record( unsigned type, unsigned addr, const unsigned char *p,
+                                                                unsigned len) {
+    unsigned sum ;
+
+    fprintf( fhex, ":%02X%04X%02X", len, addr, type) ;
+    sum = len + (addr >> 8) + addr + type ;
+    while( len--) {
+        fprintf( fhex, "%02X", *p) ;
+        sum += *p++ ;
+    }
+
+    fprintf( fhex, "%02X\r\n", -sum & 0xFF) ;
+}
+
+static void hex_flush( void) {
+    uint32_t addr = hexaddr - hexlen ;
+
+    if( hexlen == 0)
+        return ;
+
+    if( (long) (addr >> 16) != hexseg) {
+        unsigned char seg[ 2] ;
+
+        hexseg = addr >> 16 ;
+        seg[ 0] = addr >> 24 ;
+        seg[ 1] = addr >> 16 ;
+        hex_record( 4, 0, seg, 2) ;
+    }
+
+    hex_record( 0, addr & 0xFFFF, hexline, hexlen) ;
+    hexlen = 0 ;
+}
+
+static void hex_data( const unsigned char *p, size_t len) {
+    while( len--) {
+        hexline[ hexlen++] = *p++ ;
+        hexaddr += 1 ;
+        if( hexlen == sizeof hexline || (hexaddr & 0xFFFF) == 0)
+            hex_flush() ;
+    }
+}
+
+static void hex_end( void) {
+    unsigned char start[ 4] ;
+
+    hex_flush() ;
+    start[ 0] = hexentry >> 24 ;
+    start[ 1] = hexentry >> 16 ;
+    start[ 2] = hexentry >> 8 ;
+    start[ 3] = hexentry ;
+    hex_record( 5, 0, start, 4) ;
+    hex_record( 1, 0, NULL, 0) ;
+}
+
+/*
+**  -s: table of sector crcs appended to signed output, so that firmware can
+**  verify a single sector: entry n is crc of bytes [n * size, n * size + size[
+**  of signed output, last sector ending with the signature.
+*/
+static size_t sectsize ;        /* -s: sector size, multiple of 4 */
+static size_t sectfill ;        /* bytes of current sector output */
+static size_t nsect ;
+static uint32_t sectcrc ;
+static uint32_t *sectab ;
+static int sectfail ;
+
+static void end_sector( void) {
+    if( nsect % 64 == 0) {
+        uint32_t *p = realloc( sectab, (nsect + 64) * sizeof *sectab) ;
+
+        if( !p) {
+            sectfail = 1 ;
+            return ;
+        }
+
+        sectab = p ;
+    }
+
+    sectab[ nsect++] = sectcrc ;
+    sectcrc = 0xFFFFFFFF ;
+    sectfill = 0 ;
+}
+
+/* Image base address and ELF input */
+static uint32_t binloc ;        /* -b: image base address */
+static unsigned char *elfimage ;
+static size_t elfsize, elfpos ;
+
+static FILE *open_output( uint32_t base) {
+    FILE *fout ;
+
+    fout = open_stream( outname, "wb") ;
+    if( !fout) {
+        perror( outname) ;
+        return NULL ;
+    }
+
+    if( hexname) {
+        fhex = open_stream( hexname, "wb") ;
+        if( !fhex) {
+            perror( hexname) ;
+            close_stream( fout) ;
+            return NULL ;
+        }
+
+        hexaddr = base ;
+        if( !elfimage)
+            hexentry = base ;
+
+        hexseg = -1 ;
+        hexlen = 0 ;
+    }
+
+    sectcrc = 0xFFFFFFFF ;
+    sectfill = 0 ;
+    nsect = 0 ;
+    sectfail = 0 ;
+    return fout ;
+}
+
+/* Accumulate len bytes, multiple of 4, of signed image in sector crcs */
+static void add_sectors( const unsigned char *p, size_t len) {
+    while( len) {
+        size_t cnt = sectsize - sectfill ;
+
+        if( cnt > len)
+            cnt = len ;
+
+        sectcrc = check_block( sectcrc, p, cnt / 4) ;
+        sectfill += cnt ;
+        p += cnt ;
+        len -= cnt ;
+        if( sectfill == sectsize)
+            end_sector() ;
+    }
+}
+
+/* Write len bytes, multiple of 4, of signed image to all outputs */
+static void emit( FILE *fout, const void *buf, size_t len) {
+    fwrite( buf, 1, len, fout) ;
+    if( fhex)
+        hex_data( buf, len) ;
+
+    if( sectsize)
+        add_sectors( buf, len) ;
+}
+
+static int close_output( FILE *fout) {
+    int ret = EXIT_SUCCESS ;
+
+    if( sectsize) {
+        if( sectfill)
+            end_sector() ;
+
+        if( sectfail) {
+            fprintf( stderr, "%s: failed to append sector table\n", outname) ;
+            ret = EXIT_FAILURE ;
+        } else {
+            fwrite( sectab, sizeof *sectab, nsect, fout) ;
+            if( fhex)
+                hex_data( (const unsigned char *) sectab, nsect * 4) ;
+
+            fprintf( msg, "%s: %zu sectors of %zu bytes\n", outname, nsect,
+                                                                    sectsize) ;
+        }
+
+        free( sectab) ;
+        sectab = NULL ;
+    }
+
+    if( fhex) {
+        hex_end() ;
+        if( close_stream( fhex)) {
+            perror( hexname) ;
+            ret = EXIT_FAILURE ;
+        }
+
+        fhex = NULL ;
+    }
+
+    if( close_stream( fout)) {
+        perror( outname) ;
+        ret = EXIT_FAILURE ;
+    }
+
+    return ret ;
+}
+
+/*
+**  ELF input: image is made of the loadable segments with content located at
+**  or above -b address, placed at their physical (load) address, gaps filled
+**  with zeroes, same as objcopy -O binary.
+*/
+static uint32_t elf16( const unsigned char *p) {
+    return p[ 0] | p[ 1] << 8 ;
+}
+
+static uint32_t elf32( const unsigned char *p) {
+    return p[ 0] | p[ 1] << 8 | p[ 2] << 16 | (uint32_t) p[ 3] << 24 ;
+}
+
+static int load_elf( FILE *fin, const unsigned char *buf, size_t cnt,
+                                        const char *filename, uint32_t *base) {
+    unsigned char *elf, *p ;
+    size_t size, phoff, phsize, phnum, i, offset, filesz ;
+    uint64_t lo, hi, paddr ;
+
+/* whole file, first block already read */
+    elf = malloc( cnt) ;
+    if( !elf) {
+        perror( filename) ;
+        return 0 ;
+    }
+
+    memcpy( elf, buf, cnt) ;
+    size = cnt ;
+    for( ;;) {
+        p = realloc( elf, size + BUFSIZE) ;
+        if( !p) {
+            perror( filename) ;
+            free( elf) ;
+            return 0 ;
+        }
+
+        elf = p ;
+        cnt = fread( &elf[ size], 1, BUFSIZE, fin) ;
+        if( cnt == 0)
+            break ;
+
+        size += cnt ;
+    }
+
+    phoff = phsize = phnum = 0 ;
+    if( size >= 52 && elf[ 4] == 1 && elf[ 5] == 1) {    /* 32-bit, LE */
+        phoff = elf32( &elf[ 28]) ;
+        phsize = elf16( &elf[ 42]) ;
+        phnum = elf16( &elf[ 44]) ;
+        hexentry = elf32( &elf[ 24]) ;
+    }
+
+    if( phsize < 32 || phoff > size || phnum > (size - phoff) / phsize) {
+        fprintf( stderr, "%s: not a 32-bit little endian ELF executable\n",
+                                                                    filename) ;
+        free( elf) ;
+        return 0 ;
+    }
+
+/* image boundaries */
+    lo = UINT32_MAX ;
+    hi = 0 ;
+    for( i = 0 ; i < phnum ; i++) {
+        p = &elf[ phoff + i * phsize] ;
+        filesz = elf32( &p[ 16]) ;
+        paddr = elf32( &p[ 12]) ;
+        offset = elf32( &p[ 4]) ;
+        if( elf32( p) != 1 || filesz == 0 || paddr < binloc)   /* PT_LOAD */
+            continue ;
+
+        if( offset > size || filesz > size - offset) {
+            fprintf( stderr, "%s: truncated segment\n", filename) ;
+            free( elf) ;
+            return 0 ;
+        }
+
+        if( paddr < lo)
+            lo = paddr ;
+
+        if( paddr + filesz > hi)
+            hi = paddr + filesz ;
+    }
+
+    if( lo >= hi) {
+        fprintf( stderr, "%s: no loadable segment at %X\n", filename, binloc) ;
+        free( elf) ;
+        return 0 ;
+    }
+
+    elfsize = hi - lo ;
+    elfpos = 0 ;
+    elfimage = calloc( elfsize, 1) ;
+    if( !elfimage) {
+        perror( filename) ;
+        free( elf) ;
+        return 0 ;
+    }
+
+    for( i = 0 ; i < phnum ; i++) {
+        p = &elf[ phoff + i * phsize] ;
+        filesz = elf32( &p[ 16]) ;
+        paddr = elf32( &p[ 12]) ;
+        if( elf32( p) == 1 && filesz && paddr >= binloc)
+            memcpy( &elfimage[ paddr - lo], &elf[ elf32( &p[ 4])], filesz) ;
+    }
+
+    free( elf) ;
+    *base = lo ;
+    return 1 ;
+}
+
+/* Read next block of input, from ELF image if input is ELF */
+static size_t read_input( unsigned char *buf, size_t size, FILE *fin) {
+    if( !elfimage)
+        return fread( buf, 1, size, fin) ;
+
+    if( size > elfsize - elfpos)
+        size = elfsize - elfpos ;
+
+    memcpy( buf, &elfimage[ elfpos], size) ;
+    elfpos += size ;
+    return size ;
+}
 
 static int sign_file( char *filename) {
     FILE *fin, *fout ;
-    int cnt, filesize, outsize ;
-    uint32_t crc ;
-    unsigned char buf[ 4] ;
-    const char outname[] = "signed.bin" ;
+    size_t cnt, len, nwords, filesize, outsize, bufsize ;
+    int held, ret ;
+    uint32_t crc, base ;
+    unsigned char *buf ;
 
-    fin = fopen( filename, "rb") ;
+#ifdef PARALLEL
+    bufsize = jobs > 1 ? jobs * JOBSIZE : BUFSIZE ;
+#else
+    bufsize = BUFSIZE ;
+#endif
+    buf = malloc( bufsize) ;
+    if( !buf) {
+        perror( filename) ;
+        return EXIT_FAILURE ;
+    }
+
+    fin = open_stream( filename, "rb") ;
     if( !fin) {
         perror( filename) ;
+        free( buf) ;
         return EXIT_FAILURE ;
     }
 
-    fout = fopen( outname, "wb") ;
+/* ELF input is loaded in memory, binary input is streamed */
+    base = binloc ;
+    cnt = fread( buf, 1, bufsize, fin) ;
+    if( cnt >= 4 && !memcmp( buf, "\177ELF", 4)) {
+        if( !load_elf( fin, buf, cnt, filename, &base)) {
+            close_stream( fin) ;
+            free( buf) ;
+            return EXIT_FAILURE ;
+        }
+
+        cnt = read_input( buf, bufsize, fin) ;
+    }
+
+    fout = open_output( base) ;
     if( !fout) {
-        perror( outname) ;
-        fclose( fin) ;
+        free( elfimage) ;
+        elfimage = NULL ;
+        close_stream( fin) ;
+        free( buf) ;
         return EXIT_FAILURE ;
     }
 
     crc = 0xFFFFFFFF ;
     filesize = 0 ;
-    while( !feof( fin)) {
-        cnt = fread( buf, 1, sizeof buf, fin) ;
-        while( cnt == 4 && *((unsigned *) buf) == mark) {
-		/* DEADC0DE placeholder at EOF */
-	        cnt = fread( buf, 1, sizeof buf, fin) ;
-			if( cnt != 0) {
-				filesize += 4 ;
-		        crc = check_word( crc, (unsigned char *) &mark) ;
-		        fwrite( &mark, 1, 4, fout) ;
-			}
-		}
+    held = 0 ;                  /* DEADC0DE placeholder held back */
+    for( ; cnt != 0 ; cnt = read_input( buf, bufsize, fin)) {
+        len = cnt ;
+        while( len % 4)         /* pad with zeroes */
+            buf[ len++] = 0 ;
+
+        if( held) {             /* not at EOF, placeholder is data */
+            held = 0 ;
+            filesize += 4 ;
+            crc = check_word( crc, (const unsigned char *) &mark) ;
+            emit( fout, &mark, 4) ;
+        }
 
+    /* Hold back last word if DEADC0DE placeholder, dropped at EOF */
+        if( len == cnt && !memcmp( &buf[ len - 4], &mark, 4)) {
+            held = 1 ;
+            len -= 4 ;
+            cnt -= 4 ;
+        }
+
+        nwords = len / 4 ;
+        crc = check_parallel( crc, buf, nwords) ;
+        emit( fout, buf, len) ;
         filesize += cnt ;
-        if( cnt != 4) {
-            if( cnt == 0)
+    }
+
+    outsize = (filesize + 3) & ~3 ;
+    if( crc) {                  /* Sign only if input was not signed already */
+        emit( fout, &crc, 4) ;
+        outsize += 4 ;
+    }
+
+    fprintf( msg, "%08X %s: %zu, %s: %zu\n", crc, filename, filesize, outname,
+                                                                    outsize) ;
+    ret = close_output( fout) ;
+    free( elfimage) ;
+    elfimage = NULL ;
+    close_stream( fin) ;
+    free( buf) ;
+    return ret ;
+}
+
+
+/*
+**  Sign new image as a patch of old signed image of the same size, using
+**  linearity: crc( new) == crc( old) ^ crc0( old ^ new). crc0 of the
+**  difference is accumulated over changed words only, shifting by the
+**  length of unchanged words in between.
+*/
+static int patch_file( char *oldname, char *newname) {
+    FILE *fold, *fnew, *fout ;
+    long oldsize, newsize ;
+    size_t filesize, outsize, nwords, cnt, idx, i, pos, start ;
+    int inrange, ret ;
+    uint32_t crc, dcrc ;
+    static unsigned char oldbuf[ BUFSIZE], newbuf[ BUFSIZE] ;
+    unsigned char d[ 4] ;
+
+    fold = fopen( oldname, "rb") ;
+    if( !fold) {
+        perror( oldname) ;
+        return EXIT_FAILURE ;
+    }
+
+    fnew = fopen( newname, "rb") ;
+    if( !fnew) {
+        perror( newname) ;
+        fclose( fold) ;
+        return EXIT_FAILURE ;
+    }
+
+/* old crc is last word of old image */
+    fseek( fold, 0, SEEK_END) ;
+    oldsize = ftell( fold) ;
+    if( oldsize < 4 || oldsize % 4
+    || fseek( fold, -4, SEEK_END) || fread( &crc, 1, 4, fold) != 4) {
+        fprintf( stderr, "%s: not a signed image\n", oldname) ;
+        fclose( fnew) ;
+        fclose( fold) ;
+        return EXIT_FAILURE ;
+    }
+
+/* DEADC0DE placeholder at EOF of new image is dropped */
+    fseek( fnew, 0, SEEK_END) ;
+    newsize = ftell( fnew) ;
+    filesize = newsize ;
+    if( newsize >= 4 && newsize % 4 == 0
+    && !fseek( fnew, -4, SEEK_END) && fread( d, 1, 4, fnew) == 4
+    && !memcmp( d, &mark, 4))
+        filesize -= 4 ;
+
+    nwords = oldsize / 4 - 1 ;
+    if( (filesize + 3) / 4 != nwords) {
+        fprintf( stderr, "%s: size differs from %s, signing in full\n",
+                                                            newname, oldname) ;
+        fclose( fnew) ;
+        fclose( fold) ;
+        return sign_file( newname) ;
+    }
+
+    fout = open_output( binloc) ;
+    if( !fout) {
+        fclose( fnew) ;
+        fclose( fold) ;
+        return EXIT_FAILURE ;
+    }
+
+    rewind( fold) ;
+    rewind( fnew) ;
+    dcrc = 0 ;
+    pos = 0 ;                   /* words accounted for in dcrc */
+    start = 0 ;
+    inrange = 0 ;
+    for( idx = 0 ; idx < nwords ; idx += cnt) {
+        cnt = filesize - idx * 4 ;
+        if( cnt > BUFSIZE)
+            cnt = BUFSIZE ;
+
+        memset( newbuf, 0, sizeof newbuf) ;     /* pad with zeroes */
+        if( fread( newbuf, 1, cnt, fnew) != cnt) {
+            perror( newname) ;
+            break ;
+        }
+
+        cnt = (cnt + 3) / 4 ;
+        if( fread( oldbuf, 4, cnt, fold) != cnt) {
+            perror( oldname) ;
+            break ;
+        }
+
+        emit( fout, newbuf, cnt * 4) ;
+        if( !inrange && !memcmp( oldbuf, newbuf, cnt * 4))
+            continue ;
+
+        for( i = 0 ; i < cnt ; i++)
+            if( memcmp( &oldbuf[ i * 4], &newbuf[ i * 4], 4)) {
+                d[ 0] = oldbuf[ i * 4] ^ newbuf[ i * 4] ;
+                d[ 1] = oldbuf[ i * 4 + 1] ^ newbuf[ i * 4 + 1] ;
+                d[ 2] = oldbuf[ i * 4 + 2] ^ newbuf[ i * 4 + 2] ;
+                d[ 3] = oldbuf[ i * 4 + 3] ^ newbuf[ i * 4 + 3] ;
+                if( !inrange) {
+                    inrange = 1 ;
+                    start = idx + i ;
+                    dcrc = mulmod( dcrc, xpow( (uint64_t) (start - pos) * 32)) ;
+                }
+
+                dcrc = check_word( dcrc, d) ;
+                pos = idx + i + 1 ;
+            } else if( inrange) {
+                inrange = 0 ;
+                fprintf( msg, "%s: %zX-%zX\n", newname, start * 4,
+                                                                pos * 4 - 1) ;
+            }
+    }
+
+    if( inrange)
+        fprintf( msg, "%s: %zX-%zX\n", newname, start * 4, pos * 4 - 1) ;
+
+    outsize = (filesize + 3) & ~3 ;
+    if( idx >= nwords) {
+        crc ^= mulmod( dcrc, xpow( (uint64_t) (nwords - pos) * 32)) ;
+        if( crc) {              /* Sign only if input was not signed already */
+            emit( fout, &crc, 4) ;
+            outsize += 4 ;
+        }
+
+        fprintf( msg, "%08X %s: %zu, %s: %zu\n", crc, newname, filesize,
+                                                            outname, outsize) ;
+    }
+
+    ret = close_output( fout) ;
+    fclose( fnew) ;
+    fclose( fold) ;
+    return idx >= nwords ? ret : EXIT_FAILURE ;
+}
+
+/*
+**  -v: verify signed input, crc of the signed image including signature is
+**  zero. With -s, signed image is followed by its sector table, located from
+**  the input size, so input must be seekable.
+*/
+static int verify_file( char *filename) {
+    FILE *fin ;
+    size_t cnt, len, total, nwords, count, pos, i ;
+    long size ;
+    int ok ;
+    uint32_t crc, sig ;
+    unsigned char *table ;
+    static unsigned char buf[ BUFSIZE] ;
+
+    fin = open_stream( filename, "rb") ;
+    if( !fin) {
+        perror( filename) ;
+        return EXIT_FAILURE ;
+    }
+
+/* size of signed image: total == nwords + ceil( nwords / sector words) */
+    nwords = SIZE_MAX / 4 ;
+    count = 0 ;
+    table = NULL ;
+    if( sectsize) {
+        if( fseek( fin, 0, SEEK_END) || (size = ftell( fin)) < 0
+        || fseek( fin, 0, SEEK_SET)) {
+            fprintf( stderr, "%s: input must be seekable to verify sectors\n",
+                                                                    filename) ;
+            close_stream( fin) ;
+            return EXIT_FAILURE ;
+        }
+
+        total = size / 4 ;
+        for( count = total / (sectsize / 4 + 1) ; count < total ; count++)
+            if( (total - count + sectsize / 4 - 1) / (sectsize / 4) == count)
                 break ;
 
-            while( cnt < 4)     /* pad with zeroes */
-                buf[ cnt++] = 0 ;
+        nwords = total - count ;
+        table = malloc( count * 4 + 1) ;
+        if( !table) {
+            perror( filename) ;
+            close_stream( fin) ;
+            return EXIT_FAILURE ;
+        }
+    }
+
+    crc = 0xFFFFFFFF ;
+    sig = 0 ;
+    pos = 0 ;                   /* bytes of input */
+    ok = 1 ;
+    sectcrc = 0xFFFFFFFF ;
+    sectfill = 0 ;
+    nsect = 0 ;
+    sectfail = 0 ;
+    while( (cnt = fread( buf, 1, sizeof buf, fin)) != 0) {
+        if( cnt % 4) {          /* partial word only at EOF */
+            ok = 0 ;
+            cnt -= cnt % 4 ;
+        }
+
+        len = 0 ;
+        if( pos < nwords * 4) {
+            len = nwords * 4 - pos ;
+            if( len > cnt)
+                len = cnt ;
+
+            crc = check_parallel( crc, buf, len / 4) ;
+            if( sectsize)
+                add_sectors( buf, len) ;
+
+            if( len >= 4)
+                memcpy( &sig, &buf[ len - 4], 4) ;
+        }
+
+        if( cnt > len) {        /* sector table, ends at pos + cnt */
+            if( pos + cnt > (nwords + count) * 4) {
+                ok = 0 ;
+                break ;
+            }
+
+            memcpy( &table[ pos + len - nwords * 4], &buf[ len], cnt - len) ;
+        }
+
+        pos += cnt ;
+    }
+
+    if( ferror( fin)) {
+        perror( filename) ;
+        ok = 0 ;
+    }
+
+    len = pos < nwords * 4 ? pos : nwords * 4 ;
+    if( len < 4 || crc)
+        ok = 0 ;
+
+    fprintf( msg, "%08X %s: %zu, %s\n", sig, filename, len,
+                                                    ok ? "OK" : "MISMATCH") ;
+    if( sectsize) {
+        if( sectfill)
+            end_sector() ;
+
+        for( i = 0 ; i < count ; i++)
+            if( sectfail || i >= nsect
+            || memcmp( &sectab[ i], &table[ i * 4], 4)) {
+                fprintf( msg, "%s: sector %zu MISMATCH\n", filename, i) ;
+                ok = 0 ;
+            }
+
+        free( sectab) ;
+        sectab = NULL ;
+        free( table) ;
+    }
+
+    close_stream( fin) ;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE ;
+}
+
+#ifdef MMAP
+static int mapped ;             /* -m: input mapped in memory */
+static int inplace ;            /* -i: sign in place */
+
+/* Append table of sector crcs to mapped output, see -s above */
+static int append_sectors( const char *name) {
+    FILE *f ;
+    long size ;
+    size_t cnt, count, i ;
+    unsigned char *buf ;
+    uint32_t *table ;
+
+    f = fopen( name, "r+b") ;
+    if( !f) {
+        perror( name) ;
+        return EXIT_FAILURE ;
+    }
+
+    fseek( f, 0, SEEK_END) ;
+    size = ftell( f) ;
+    rewind( f) ;
+    count = (size + sectsize - 1) / sectsize ;
+    buf = malloc( sectsize) ;
+    table = malloc( count * sizeof *table + 1) ;
+    if( !buf || !table) {
+        perror( name) ;
+        count = 0 ;
+    }
+
+    for( i = 0 ; i < count ; i++) {
+        cnt = fread( buf, 1, sectsize, f) ;
+        if( cnt == 0 || cnt % 4)
+            break ;
+
+        table[ i] = check_block( 0xFFFFFFFF, buf, cnt / 4) ;
+    }
+
+    fseek( f, 0, SEEK_END) ;
+    if( i != count || fwrite( table, sizeof *table, count, f) != count) {
+        fprintf( stderr, "%s: failed to append sector table\n", name) ;
+        count = 0 ;
+    } else
+        fprintf( msg, "%s: %zu sectors of %zu bytes\n", name, count, sectsize) ;
+
+    free( table) ;
+    free( buf) ;
+    fclose( f) ;
+    return count ? EXIT_SUCCESS : EXIT_FAILURE ;
+}
+
+static int sign_mapped( char *filename) {
+    int fin, fout, ok ;
+    struct stat st ;
+    size_t filesize, outsize, nwords ;
+    uint32_t crc ;
+    unsigned char *map ;
+    const char *name = inplace ? filename : outname ;
+
+    fin = open( filename, inplace ? O_RDWR : O_RDONLY) ;
+    if( fin == -1 || fstat( fin, &st) == -1) {
+        perror( filename) ;
+        if( fin != -1)
+            close( fin) ;
+
+        return EXIT_FAILURE ;
+    }
+
+    filesize = st.st_size ;
+    map = NULL ;
+    if( filesize) {
+        map = mmap( NULL, filesize, PROT_READ, MAP_SHARED, fin, 0) ;
+        if( map == MAP_FAILED) {
+            perror( filename) ;
+            close( fin) ;
+            return EXIT_FAILURE ;
         }
+    }
+
+/* DEADC0DE placeholder at EOF is dropped */
+    if( filesize % 4 == 0 && filesize
+    && !memcmp( &map[ filesize - 4], &mark, 4))
+        filesize -= 4 ;
+    else if( inplace) {
+        fprintf( stderr, "%s: no DEADC0DE placeholder to sign in place\n",
+                                                                    filename) ;
+        munmap( map, filesize) ;
+        close( fin) ;
+        return EXIT_FAILURE ;
+    }
 
+    nwords = filesize / 4 ;
+    crc = check_parallel( 0xFFFFFFFF, map, nwords) ;
+    if( filesize % 4) {         /* pad with zeroes */
+        unsigned char buf[ 4] = { 0, 0, 0, 0 } ;
+
+        memcpy( buf, &map[ nwords * 4], filesize % 4) ;
         crc = check_word( crc, buf) ;
-        fwrite( buf, 1, 4, fout) ;
     }
 
     outsize = (filesize + 3) & ~3 ;
-    if( crc) {                  /* Sign only if input was not signed already */
-        fwrite( &crc, 1, 4, fout) ;
-        outsize += 4 ;
+    ok = 1 ;
+    if( inplace)
+        fout = fin ;
+    else {
+        fout = open( name, O_WRONLY | O_CREAT | O_TRUNC, 0666) ;
+        if( fout == -1) {
+            perror( name) ;
+            munmap( map, st.st_size) ;
+            close( fin) ;
+            return EXIT_FAILURE ;
+        }
+
+    /* Clone input if possible, otherwise copy from the mapping */
+# ifdef FICLONE
+        if( ioctl( fout, FICLONE, fin) == -1)
+# endif
+        {
+            size_t len ;
+            ssize_t cnt ;
+
+            for( len = 0 ; len < filesize ; len += cnt) {
+                cnt = write( fout, &map[ len], filesize - len) ;
+                if( cnt <= 0) {
+                    ok = 0 ;
+                    break ;
+                }
+            }
+        }
     }
 
-    printf( "%08X %s: %i, %s: %i\n", crc, filename, filesize, outname, outsize) ;
-    fclose( fout) ;
-    fclose( fin) ;
-    return EXIT_SUCCESS ;
+/* Drop placeholder or pad with zeroes, then sign */
+    if( !ok || ftruncate( fout, outsize) == -1
+    || (crc && pwrite( fout, &crc, 4, outsize) != 4)) {
+        perror( name) ;
+        ok = 0 ;
+    } else {
+        if( crc)                /* Sign only if input was not signed already */
+            outsize += 4 ;
+
+        fprintf( msg, "%08X %s: %zu, %s: %zu\n", crc, filename, filesize,
+                                                            name, outsize) ;
+    }
+
+    if( fout != fin)
+        close( fout) ;
+
+    if( map)
+        munmap( map, st.st_size) ;
+
+    close( fin) ;
+    if( !ok)
+        return EXIT_FAILURE ;
+
+    return sectsize ? append_sectors( name) : EXIT_SUCCESS ;
 }
+#endif
+
 
+static int usage( const char *name) {
+    fprintf( stderr, "usage: %s [-v] [--patch old] [-s sectsize] [-b addr]"
+                                " [-o out.bin|-] [-x out.hex|-]"
+#ifdef PARALLEL
+                                " [-j[jobs]]"
+#endif
+#ifdef MMAP
+                                " [-m|-i]"
+#endif
+                                " file|file.elf|- ...\n", name) ;
+    return EXIT_FAILURE ;
+}
 
 int main( int argc, char *argv[]) {
+    int c ;
     int ret = EXIT_SUCCESS ;
+    int verify = 0 ;
+    char *oldname = NULL ;
+    static const struct option longopts[] = {
+        { "patch", required_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    } ;
+
+    while( (c = getopt_long( argc, argv, "b:j::mio:p:s:vx:", longopts, NULL))
+                                                                        != -1)
+        switch( c) {
+        case 'b':
+            binloc = strtoul( optarg, NULL, 0) ;
+            break ;
+        case 'o':
+            outname = optarg ;
+            break ;
+        case 'x':
+            hexname = optarg ;
+            break ;
+        case 'v':
+            verify = 1 ;
+            break ;
+        case 'p':
+            oldname = optarg ;
+            break ;
+        case 's':
+            sectsize = strtoul( optarg, NULL, 0) ;
+            if( sectsize == 0 || sectsize % 4)
+                return usage( argv[ 0]) ;
+
+            break ;
+#ifdef MMAP
+        case 'i':
+            inplace = 1 ;
+            /* fallthrough */
+        case 'm':
+            mapped = 1 ;
+            break ;
+#endif
+#ifdef PARALLEL
+        case 'j':
+            if( optarg)
+                jobs = atoi( optarg) ;
+            else
+                jobs = sysconf( _SC_NPROCESSORS_ONLN) ;
+
+            if( jobs < 1)
+                jobs = 1 ;
+            else if( jobs > MAXJOBS)
+                jobs = MAXJOBS ;
+
+            break ;
+#endif
+        default:
+            return usage( argv[ 0]) ;
+        }
+
+/* only one output to stdout, summary then goes to stderr */
+    msg = stdout ;
+    if( !strcmp( outname, "-") || (hexname && !strcmp( hexname, "-"))) {
+        if( !strcmp( outname, "-") && hexname && !strcmp( hexname, "-"))
+            return usage( argv[ 0]) ;
+
+        msg = stderr ;
+    }
 
-    while( (ret == EXIT_SUCCESS) && *++argv)
-        ret = sign_file( *argv) ;
+#ifdef MMAP
+    if( mapped && (hexname || msg == stderr))   /* HEX, stdout are streams */
+        return usage( argv[ 0]) ;
+
+#endif
+#ifdef SLICE
+    init_slices() ;
+#endif
+#ifdef CLMUL
+    init_clmul() ;
+#endif
+    for( argv += optind ; (ret == EXIT_SUCCESS) && *argv ; argv++) {
+        if( verify)
+            ret = verify_file( *argv) ;
+        else if( oldname)
+            ret = patch_file( oldname, *argv) ;
+        else
+#ifdef MMAP
+        if( mapped)
+            ret = sign_mapped( *argv) ;
+        else
+#endif
+            ret = sign_file( *argv) ;
+    }
 
     return ret ;
 }
 #endif
+#endif
 
 /* end of sign32.c */
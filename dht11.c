@@ -11,11 +11,19 @@
 #define dht11_output()  gpioa_output( DIO)
 #define dht11_bread()   gpioa_read( DIO)
 
-#define MAX_RETRIES 200         /* at 48 MHz, 160 retries for 80 us HIGH */
+/* wait_level() timeout: 100 us, longest level is 80 us + 25%.
+** Measured from flash at 48 MHz: 160 retries for 80 us HIGH, 24 cycles per
+** retry. From RAM without wait state a retry takes at least 16 cycles: BLX
+** and BX 6, gpioa_read() 6, retry test and branch 4. Budget computed for 16
+** cycles, timeout is then 100 us to 150 us at any SYSCLK: 300 at 48 MHz.
+*/
+#define TIMEOUT_US      100
+#define RETRY_CYCLES    16
+#define MAX_RETRIES     (clock_get() / (1000000 / TIMEOUT_US) / RETRY_CYCLES)
 #define is_not_LOW( a) a != LOW
 #define is_not_HIGH( a) a == LOW
 #define wait_level( lvl) \
-    retries = MAX_RETRIES ; \
+    retries = max_retries ; \
     while( is_not_##lvl( dht11_bread())) \
         if( retries-- == 0) \
             return DHT11_FAIL_TOUT
@@ -32,8 +40,9 @@ void dht11_init( void) {
     dht11_input() ;
 }
 
-dht11_retv_t dht11_read( void) {
+RAMFUNC dht11_retv_t dht11_read( void) {
     unsigned char values[ 5] ;
+    int max_retries = MAX_RETRIES ;     /* once, out of the timed loops */
 
 /* Host START: pulls line down for > 18ms then release line, pull-up raises to HIGH */
     dht11_output() ;
@@ -50,7 +59,7 @@ dht11_retv_t dht11_read( void) {
  *  1 coded as 50us low then 70us high
  */
     wait_level( LOW) ; /* HIGH -> LOW, ends 80us high, starts 50us low */
-    int threshold = (MAX_RETRIES + retries) / 2 ;
+    int threshold = (max_retries + retries) / 2 ;
 
     unsigned char sum = 0 ;
     unsigned char v = 0 ;
@@ -5,28 +5,27 @@
 #include "system.h"
 #include "dht11.h"
 
+static void sample( void) {
+    switch( dht11_read()) {
+    case DHT11_SUCCESS:
+        printf( "%u%%RH, %d.%uC, %d\n", dht11_humid, dht11_tempc,
+                                         dht11_tempf, dht11_deciC) ;
+        break ;
+    case DHT11_FAIL_TOUT:
+        puts( "Timeout") ;
+        break ;
+    case DHT11_FAIL_CKSUM:
+        puts( "Cksum error") ;
+    }
+}
+
 int main( void) {
-    unsigned last = 0 ;
+    static swtimer_t tick ;
 
     dht11_init() ;
+    timer_start( &tick, 2000, 5000, sample) ;   /* every 5s, first after 2s */
     for( ;;)
-        if( last == uptime)
-            yield() ;
-        else {
-            last = uptime ;
-            if( 2 == (last % 5))    /* every 5 seconds starting 2s after boot */
-                switch( dht11_read()) {
-                case DHT11_SUCCESS:
-                    printf( "%u%%RH, %d.%uC, %d\n", dht11_humid, dht11_tempc,
-                                                     dht11_tempf, dht11_deciC) ;
-                    break ;
-                case DHT11_FAIL_TOUT:
-                    puts( "Timeout") ;
-                    break ;
-                case DHT11_FAIL_CKSUM:
-                    puts( "Cksum error") ;
-                }
-        }
+        yield() ;
 }
 
 /* end of dht11main.c */
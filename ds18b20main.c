@@ -3,35 +3,35 @@
 
 #include <stdio.h>
 
-#include "system.h"     /* uptime */
+#include "system.h"     /* yield(), timer_start() */
 #include "ds18b20.h"    /* ds18b20_() */
 
+static void sample( void) {     /* every second, conversion takes 750ms */
+    short val ;
+
+    switch( ds18b20_fetch( &val)) {
+    case DS18B20_SUCCESS:
+        printf( "%i.%i\n", val / 10, val % 10) ;
+        break ;
+    case DS18B20_FAIL_TOUT:
+        puts( "Timeout") ;
+        break ;
+    case DS18B20_FAIL_CRC:
+        puts( "CRC Error") ;
+    }
+
+    ds18b20_convert() ; /* start temperature conversion */
+}
+
 int main( void) {
-    unsigned last = 0 ;
+    static swtimer_t tick ;
 
     ds18b20_init() ;
     ds18b20_resolution( 12) ;   /* Set highest resolution: 12 bits */
     ds18b20_convert() ;         /* start temperature conversion */
+    timer_start( &tick, 1000, 1000, sample) ;
     for( ;;)
-        if( last == uptime)
-            yield() ;
-        else {
-            short val ;
-
-            last = uptime ;
-            switch( ds18b20_fetch( &val)) {
-            case DS18B20_SUCCESS:
-                printf( "%i.%i\n", val / 10, val % 10) ;
-                break ;
-            case DS18B20_FAIL_TOUT:
-                puts( "Timeout") ;
-                break ;
-            case DS18B20_FAIL_CRC:
-                puts( "CRC Error") ;
-            }
-
-            ds18b20_convert() ; /* start temperature conversion */
-        }
+        yield() ;
 }
 
 /* end of ds18b20main.c */
@@ -0,0 +1,102 @@
+/* event.c -- ISR to thread event queue, dispatched by yield()
+** Copyright (c) 2025 Renaud Fivet
+**
+** Handlers post small events (id, arg) with event_post(), yield() calls
+** event_dispatch() which runs the registered callbacks in thread context
+** before sleeping. Single producer side: posting handlers share the same
+** priority (reset default) so they never preempt each other, head is only
+** written by them and tail only by the thread, no interrupt masking.
+** Latency is measured with now_cycles() of the system layer (adc.c,
+** txeie.c, gpioa.c).
+*/
+
+#include "system.h" /* implements system.h event API */
+
+
+/** CORE **********************************************************************/
+
+#define SCB_SCR                 (*(volatile long *) 0xE000ED10)
+#define SCB_SCR_SLEEPONEXIT     2   /* 1: Sleep on return to thread mode */
+
+
+/** Event queue ***************************************************************/
+
+#define QUEUE_SIZE  16              /* power of 2 */
+#define barrier()   __asm( "" ::: "memory")
+
+static struct {
+    unsigned char id ;
+    unsigned arg ;
+    unsigned stamp ;                /* now_cycles() at post */
+} queue[ QUEUE_SIZE] ;
+
+static volatile unsigned head ;     /* written by handlers */
+static volatile unsigned tail ;     /* written by thread */
+static void (*handlers[ EVENTS])( unsigned arg) ;
+
+unsigned event_overflows ;          /* events lost, queue full */
+unsigned event_latency_max ;        /* HCLK cycles from post to dispatch */
+
+int event_register( event_t id, void (*fn)( unsigned arg)) {
+    if( id >= EVENTS)
+        return -1 ;
+
+    handlers[ id] = fn ;
+    return 0 ;
+}
+
+int event_post( event_t id, unsigned arg) { /* handler, -1 when full */
+    unsigned h = head ;
+
+    if( id >= EVENTS || handlers[ id] == 0)
+        return 0 ;                  /* nobody listens */
+
+    if( h - tail == QUEUE_SIZE) {
+        event_overflows += 1 ;
+        return -1 ;
+    }
+
+    queue[ h % QUEUE_SIZE].id = id ;
+    queue[ h % QUEUE_SIZE].arg = arg ;
+    queue[ h % QUEUE_SIZE].stamp = now_cycles() ;
+    barrier() ;                     /* entry written before it is published */
+    head = h + 1 ;
+    SCB_SCR &= ~SCB_SCR_SLEEPONEXIT ;   /* adc.c idle: back to thread mode */
+    return 0 ;
+}
+
+int event_pending( void) {          /* yield(), nonzero before sleeping */
+    return head != tail ;
+}
+
+int event_dispatch( void) {         /* yield(), count of dispatched events */
+    static int running ;            /* yield() from a callback */
+    unsigned h = head ;             /* events posted from now on wait */
+    int cnt = 0 ;
+
+    if( running)
+        return 0 ;
+
+    running = 1 ;
+    while( tail != h) {
+        unsigned t = tail ;
+        event_t id = queue[ t % QUEUE_SIZE].id ;
+        unsigned arg = queue[ t % QUEUE_SIZE].arg ;
+        unsigned latency = now_cycles() - queue[ t % QUEUE_SIZE].stamp ;
+
+        barrier() ;                 /* entry read before slot is released */
+        tail = t + 1 ;
+        if( latency > event_latency_max)
+            event_latency_max = latency ;
+
+        if( handlers[ id])
+            handlers[ id]( arg) ;
+
+        cnt += 1 ;
+    }
+
+    running = 0 ;
+    return cnt ;
+}
+
+/* end of event.c */
@@ -24,8 +24,12 @@
 #define NVIC                    ((volatile long *) 0xE000E100)
 #define NVIC_ISER               NVIC[ 0]
 #define unmask_irq( idx)        NVIC_ISER = 1 << idx
+#define TIM16_IRQ_IDX           21
 #define USART1_IRQ_IDX          27
 
+#define SCB_ICSR                (*(volatile long *) 0xE000ED04)
+#define SCB_ICSR_PENDSTSET      (1 << 26)   /* 26: SysTick pending */
+
 
 /** PERIPH ********************************************************************/
 
@@ -61,6 +65,13 @@
 
 #define RCC_APB2ENR             RCC[ 6]
 #define RCC_APB2ENR_USART1EN    0x00004000  /* 14: USART1 clock enable */
+#define RCC_APB2ENR_TIM16EN     0x00020000  /* 17: TIM16 clock enable */
+
+#define RCC_CFGR2               RCC[ 11]    /* 3-0: PLL PREDIV */
+
+#define FLASH                   ((volatile long *) 0x40022000)
+#define FLASH_ACR               FLASH[ 0]
+#define FLASH_ACR_LATENCY       1           /*  0: One wait state */
 
 #define GPIOA                   ((volatile long *) 0x48000000)
 #define GPIOB                   ((volatile long *) 0x48000400)
@@ -70,6 +81,20 @@
 #define ODR     5
 #define AFRH    9
 
+#define TIM16                   ((volatile long *) 0x40014400)
+#define TIM16_CR1               TIM16[ 0]
+#define TIM16_DIER              TIM16[ 3]
+#define TIM16_SR                TIM16[ 4]
+#define TIM16_EGR               TIM16[ 5]
+#define TIM16_PSC               TIM16[ 10]
+#define TIM16_ARR               TIM16[ 11]
+#define TIM_CR1_CEN             1           /*  0: Counter enable */
+#define TIM_CR1_URS             4           /*  2: Update on overflow only */
+#define TIM_CR1_OPM             8           /*  3: One pulse mode */
+#define TIM_DIER_UIE            1           /*  0: Update interrupt enable */
+#define TIM_SR_UIF              1           /*  0: Update interrupt flag */
+#define TIM_EGR_UG              1           /*  0: Update generation */
+
 #define USART1                  ((volatile long *) 0x40013800)
 #define CR1     0               /* Config Register */
 #define BRR     3               /* BaudRate Register */
@@ -87,41 +112,25 @@
 #define LED_ON  0
 /* 8MHz quartz, configure PLL at 24MHz */
 #define HSE     8000000
-#define PLL     6
+#define SYSCLK  24000000
 #define BAUD    9600
+/* SysTick rate, 1 Hz by default as each tick delays 1-Wire and DHT11 bit
+** sampling, timer.c software timers then expire on second boundaries */
+//#define TICK    1000
 
-#ifdef PLL
-# ifdef HSE
-#  define CLOCK HSE / 2 * PLL
-# else /* HSI */
-#  define CLOCK 8000000 / 2 * PLL
-# endif
-# if CLOCK < 16000000
-#  error PLL output below 16MHz
-# endif
-#elif defined( HSE)
-# define CLOCK HSE
-#else /* HSI */
-# define CLOCK 8000000
-#endif
-
-#if CLOCK > 48000000
-# error clock frequency exceeds 48MHz
-#endif
-
-#if CLOCK % BAUD
-# warning baud rate not accurate at that clock frequency
-#endif
+#include "clocktree.h"  /* CLOCK, PLL, HSEPRE, USARTDIV, TICKDIV, TICKRVR */
 
 static unsigned char txbuf[ 8] ; // best if size is a power of 2 for cortex-M0
 #define TXBUF_SIZE (sizeof txbuf / sizeof txbuf[ 0])
 static unsigned char            txbufin ;
 static volatile unsigned char   txbufout ;
 
-void USART1_Handler( void) {
+RAMFUNC void USART1_Handler( void) {
     if( txbufout == txbufin) {
     /* Empty buffer => Disable TXEIE */
         USART1[ CR1] &= ~USART_CR1_TXEIE ;
+        if( event_post)
+            event_post( EV_TXEMPTY, 0) ;
     } else {
         static unsigned char lastc ;
         unsigned char c ;
@@ -164,10 +173,32 @@ int kputs( const char s[]) {    /* string output */
 }
 
 void yield( void) {             /* give way */
-    __asm( "WFI") ; /* Wait for System Tick Interrupt */
+    if( event_dispatch && event_dispatch())
+        return ;                /* events dispatched, no wait */
+
+    if( timer_run && timer_run())
+        return ;                /* timers expired, no wait */
+
+    if( task_yield && task_yield())
+        return ;                /* other tasks ran, no wait */
+
+#ifdef CRC32IDLE
+    if( flash_status == 0) {    /* flash check in progress, no wait */
+        check_flash_slice() ;
+        return ;
+    }
+
+#endif
+/* no event posted between dispatch and WFI, serviced once unmasked */
+    __asm( "CPSID i") ;
+    if( !(event_pending && event_pending()))
+        __asm( "WFI") ; /* Wait for System Tick Interrupt */
+
+    __asm( "CPSIE i") ;
 }
 
 volatile unsigned uptime ;      /* seconds elapsed since boot */
+static volatile unsigned ticks ;    /* SysTick periods since boot */
 
 #ifdef LED_ON
 static void userLEDtoggle( void) {
@@ -175,20 +206,157 @@ static void userLEDtoggle( void) {
 }
 #endif
 
-void SysTick_Handler( void) {
+RAMFUNC void SysTick_Handler( void) {
+    ticks += 1 ;
+    if( timer_tick)
+        timer_tick( 1000 / TICK) ;
+
+#if TICK > 1
+    static unsigned subtick ;
+
+    if( ++subtick < TICK)
+        return ;
+
+    subtick = 0 ;
+#endif
     uptime += 1 ;
+    if( event_post)
+        event_post( EV_SECOND, uptime) ;
+
 #ifdef LED_ON
     userLEDtoggle() ;
 #endif
 }
 
 
-void usleep( unsigned usecs) {      /* wait at least usec µs */
-#if CLOCK / 8000000 < 1
-# error HCLK below 8 MHz
-#endif
-    usecs = SYSTICK_CVR - (CLOCK / 8000000 * usecs) ;
-    while( SYSTICK_CVR > usecs) ;
+/* usleep() and usleep_async() on TIM16 one-shot, 1us resolution, waits
+** over 32768us are chained from TIM16_Handler. usleep() spins on short waits
+** and sleeps on longer ones.
+*/
+#define USLEEP_SPIN 100             /* us, WFI from there */
+
+static volatile int usleep_busy ;       /* TIM16 in use */
+static volatile unsigned usleep_left ;  /* us after current shot */
+static void (*usleep_cb)( void) ;       /* async completion, ISR context */
+
+RAMFUNC static void tim16_shot( void) { /* next shot, at most 32768us */
+    unsigned usecs = usleep_left > 0x8000 ? 0x8000 : usleep_left ;
+
+    usleep_left -= usecs ;
+    TIM16_CR1 = TIM_CR1_OPM | TIM_CR1_URS ;     /* one-shot, stopped */
+    TIM16_PSC = CLOCK / 2000000 - 1 ;           /* 2MHz counter */
+    TIM16_ARR = 2 * usecs - 1 ;                 /* ARR 0 stops counter */
+    TIM16_EGR = TIM_EGR_UG ;                    /* load PSC, CNT = 0 */
+    TIM16_SR = 0 ;
+    TIM16_CR1 |= TIM_CR1_CEN ;
+}
+
+RAMFUNC static int tim16_arm( unsigned usecs, void (*cb)( void), int irq) {
+    if( usleep_busy)
+        return -1 ;
+
+    usleep_busy = 1 ;
+    usleep_left = usecs ? usecs : 1 ;
+    usleep_cb = cb ;
+    TIM16_DIER = irq ? TIM_DIER_UIE : 0 ;
+    tim16_shot() ;
+    return 0 ;
+}
+
+void TIM16_Handler( void) {
+    TIM16_SR = 0 ;                      /* clear UIF */
+    if( usleep_left)
+        tim16_shot() ;
+    else {
+        void (*cb)( void) = usleep_cb ;
+
+        TIM16_DIER = 0 ;
+        usleep_busy = 0 ;
+        if( cb)
+            cb() ;
+    }
+}
+
+int usleep_async( unsigned usecs, void (*cb)( void)) {
+    return tim16_arm( usecs, cb, 1) ;   /* -1 if TIM16 is busy */
+}
+
+/* Sleep until TIM16 is released, interrupts are masked between test and WFI
+** so that completion can't be missed, a pending interrupt still wakes up */
+RAMFUNC static void tim16_wait( void) {
+    for( ;;) {
+        __asm( "CPSID i") ;
+        if( !usleep_busy)
+            break ;
+
+        __asm( "WFI") ;
+        __asm( "CPSIE i") ;
+    }
+
+    __asm( "CPSIE i") ;
+}
+
+RAMFUNC void usleep( unsigned usecs) {      /* wait at least usecs µs */
+    tim16_wait() ;                          /* usleep_async() in progress */
+    if( usecs < USLEEP_SPIN) {
+        tim16_arm( usecs, 0, 0) ;
+        do {} while( !(TIM16_SR & TIM_SR_UIF)) ;
+        usleep_busy = 0 ;
+    } else {
+        tim16_arm( usecs, 0, 1) ;
+        tim16_wait() ;
+    }
+}
+
+
+/* High resolution time ******************************************************/
+/* SysTick periods combined with SysTick count, a reload not yet accounted for by
+** SysTick_Handler (interrupts masked or higher priority ISR) is detected by
+** PENDSTSET, SysTick count is then read again after the reload.
+*/
+static unsigned now_sample( unsigned *counts) { /* ticks, counts in tick */
+    unsigned up ;
+    unsigned cvr ;
+    int pending ;
+
+    do {
+        up = ticks ;
+        cvr = SYSTICK_CVR ;
+        pending = (SCB_ICSR & SCB_ICSR_PENDSTSET) != 0 ;
+        if( pending)
+            cvr = SYSTICK_CVR ;
+    } while( up != ticks) ;
+
+    *counts = SYSTICK_RVR - cvr ;
+    return up + pending ;
+}
+
+unsigned now_us( void) {            /* us since boot, wraps every 71 min */
+    unsigned counts ;
+    unsigned up = now_sample( &counts) ;
+
+    return up * (1000000 / TICK) + counts / TICKUS ;
+}
+
+unsigned long long now_us64( void) {    /* us since boot */
+    unsigned counts ;
+    unsigned long long up = now_sample( &counts) ;
+
+    return up * (1000000 / TICK) + counts / TICKUS ;
+}
+
+unsigned now_cycles( void) {        /* HCLK cycles since boot, wraps */
+    unsigned counts ;
+    unsigned up = now_sample( &counts) ;
+
+    return up * (CLOCK / TICK) + counts * TICKDIV ;
+}
+
+unsigned long long now_cycles64( void) {    /* HCLK cycles since boot */
+    unsigned counts ;
+    unsigned long long up = now_sample( &counts) ;
+
+    return up * (CLOCK / TICK) + counts * TICKDIV ;
 }
 
 
@@ -202,12 +370,15 @@ void gpioa_output( int pin) {       /* Configure GPIOA pin as output */
     GPIOA[ MODER] |= 1 << (pin * 2) ;       /* Apin output (over [00]) */
 }
 
-iolvl_t gpioa_read( int pin) {      /* Read level of GPIOA pin */
+RAMFUNC iolvl_t gpioa_read( int pin) {  /* Read level of GPIOA pin */
     return LOW != (GPIOA[ IDR] & (1 << pin)) ;
 }
 
 
-int init( void) {
+/* Clock setup, called at reset before memory initialization: no use of
+** static data. Reset_Handler then initializes memory at full speed.
+*/
+void clock_init( void) {
 /* By default SYSCLK == HSI [8MHZ] */
 
 #ifdef HSE
@@ -215,18 +386,26 @@ int init( void) {
     RCC_CR |= RCC_CR_HSEON ;
 /* Wait for oscillator to stabilize */
     do {} while( (RCC_CR & RCC_CR_HSERDY) == 0) ;
+    boot_mark( BOOT_HSE) ;
 #endif
 
 #ifdef PLL
-/* Setup PLL HSx/2 * 6 [24MHz] */
+/* Setup PLL HSI/2 or HSE/HSEPRE * PLL [CLOCK] */
     /* Default 0: PLL HSI/2 src, PLL MULL * 2 */
-    RCC_CFGR =
 # ifdef HSE
-                RCC_CFGR_PLLSRC_HSE | RCC_CFGR_PLLXTPRE_DIV2 |
+    RCC_CFGR  = RCC_CFGR_PLLSRC_HSE | RCC_CFGR_PLLMUL( PLL) ;
+    RCC_CFGR2 = HSEPRE - 1 ;        /* PREDIV[0] is also PLLXTPRE */
+# else
+    RCC_CFGR  = RCC_CFGR_PLLMUL( PLL) ;
 # endif
-                RCC_CFGR_PLLMUL( PLL) ;
     RCC_CR |= RCC_CR_PLLON ;
     do {} while( (RCC_CR & RCC_CR_PLLRDY) == 0) ;   /* Wait for PLL */
+    boot_mark( BOOT_PLL) ;
+
+# if CLOCK > 24000000
+/* One flash wait state above 24MHz, prefetch buffer is enabled at reset */
+    FLASH_ACR |= FLASH_ACR_LATENCY ;
+# endif
 
 /* Switch to PLL as system clock SYSCLK == PLL [24MHz] */
     RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_SW_MSK) | RCC_CFGR_SW_PLL ;
@@ -241,13 +420,13 @@ int init( void) {
 /* Switch off HSI */
     RCC_CR &= ~RCC_CR_HSION ;
 #endif
+}
 
-/* SYSTICK */
-    SYSTICK_RVR = CLOCK / 8 - 1 ;   /* HBA / 8 */
-    SYSTICK_CVR = 0 ;
-    SYSTICK_CSR = 3 ;               /* HBA / 8, Interrupt ON, Enable */
-    /* SysTick_Handler will execute every 1s from now on */
+unsigned clock_get( void) {         /* SYSCLK fixed at compile time */
+    return CLOCK ;
+}
 
+int init( void) {
 #ifdef LED_ON
 /* User LED ON */
     RCC_AHBENR |= RCC_AHBENR_IOPh( LED_IOP) ;       /* Enable IOPx periph */
@@ -265,12 +444,28 @@ int init( void) {
     GPIOA[ MODER] |= 0x0A << (9 * 2) ;  /* PA9-10 ALT 10, over default 00 */
     GPIOA[ AFRH] |= 0x110 ;             /* PA9-10 AF1 0001, over default 0000 */
     RCC_APB2ENR |= RCC_APB2ENR_USART1EN ;
-    USART1[ BRR] = CLOCK / BAUD ;       /* PCLK is default source */
+    USART1[ BRR] = USARTDIV ;           /* PCLK is default source */
     USART1[ CR1] |= USART_CR1_UE | USART_CR1_TE ;   /* Enable USART & Tx */
 
 /* Unmask USART1 irq */
     unmask_irq( USART1_IRQ_IDX) ;
 
+    boot_mark( BOOT_USART) ;     /* before SysTick is set for uptime */
+
+/* TIM16 one-shot for usleep() */
+    RCC_APB2ENR |= RCC_APB2ENR_TIM16EN ;
+    unmask_irq( TIM16_IRQ_IDX) ;
+
+/* SYSTICK */
+    SYSTICK_RVR = TICKRVR ;         /* HCLK / [8,1] */
+    SYSTICK_CVR = 0 ;
+#if TICKDIV == 8
+    SYSTICK_CSR = 3 ;               /* HCLK / 8, Interrupt ON, Enable */
+#else
+    SYSTICK_CSR = 7 ;               /* HCLK, Interrupt ON, Enable */
+#endif
+    /* SysTick_Handler will execute TICK times per second from now on */
+
     kputs(
 #ifdef PLL
         "PLL"
@@ -282,6 +477,9 @@ int init( void) {
 #endif
         "\n") ;
 
+#ifdef BOOTPROF
+    boot_report( CLOCK) ;
+#endif
     return 0 ;
 }
 
@@ -1,5 +1,12 @@
 /* startup.crc.c -- entry point at reset and C startup
 ** Copyright (c) 2020-2021 Renaud Fivet
+** v15: boot phases timed when BOOTPROF
+** v14: flash CRC32 check skipped on warm reset of a verified image
+** v13: RAM initialized from linker copy and zero tables, by 16 bytes
+** v12: clock setup before memory initialization, boot timing
+** v11: flash CRC32 checked in background from yield() when CRC32IDLE
+** v10: flash CRC32 fed by DMA while memory initializes
+** v9: per sector flash CRC32 validation
 ** v8: flash CRC32 validation
 ** v7: isr vector mapped to RAM to enable in RAM execution
 ** v6: device specific interrupts mapped
@@ -16,10 +23,21 @@
 /* Memory locations defined by linker script */
 void __StackTop( void) ;        /* __StackTop points after end of stack */
 void Reset_Handler( void) ;     /* Entry point for execution */
-extern const long __etext[] ;   /* start of initialized data copy in flash */
-extern long __data_start__[] ;
-extern long __bss_start__[] ;
-extern long __bss_end__ ;       /* &__bss_end__ points after end of bss */
+
+/* RAM regions to initialize, tables defined by linker script */
+typedef const struct {
+    const long *src ;           /* initial value in FLASH */
+    long *dst ;                 /* region in RAM */
+    unsigned size ;             /* bytes, multiple of 4 */
+} copy_t ;
+
+typedef const struct {
+    long *dst ;                 /* region in RAM */
+    unsigned size ;             /* bytes, multiple of 4 */
+} zero_t ;
+
+extern copy_t __copy_table_start__[], __copy_table_end__[] ;
+extern zero_t __zero_table_start__[], __zero_table_end__[] ;
 
 /* Stubs for System Exception Handler */
 void Default_Handler( void) ;
@@ -112,54 +130,234 @@ isr_p const isr_vector[ 16 + 32] __attribute__((section(".isr_vector"))) = {
 } ;
 
 #if RAMISRV == 2
+/* isr vector copied to beginning of RAM as part of .copy.table */
 # define ISRV_SIZE (sizeof isr_vector / sizeof *isr_vector)
 isr_p ram_vector[ ISRV_SIZE] __attribute__((section(".ram_vector"))) ;
 #endif
 
 int main( void) ;
 
+#ifdef BOOTPROF
+unsigned boot_cycles ;          /* HCLK cycles of memory initialization */
+unsigned boot_prof[ BOOT_PHASES] NOINIT ;  /* updated before RAM init */
+static unsigned boot_last NOINIT ;          /* SysTick at previous mark */
+
+void boot_mark( enum bootphase phase) {
+    unsigned now = SYSTICK_CVR ;
+
+    boot_prof[ phase] = (boot_last - now) & 0xFFFFFF ;   /* 24-bit down */
+    boot_last = now ;
+}
+#endif
+
 #ifdef CRC32SIGN
 const unsigned crcsum __attribute__((section(".crc_chk"))) = 0xDEC0ADDE ;
+#define SIGNATURE   (*(const volatile unsigned *) &crcsum)  /* not folded */
+
+/* Warm reset: software or watchdog reset after the image was verified. The
+** record is kept in .noinit RAM and bound to the image signature, so a newly
+** flashed image is verified again.
+*/
+#define WARM_MAGIC  0x5741524D      /* "WARM" */
+static struct {
+    unsigned magic ;
+    unsigned signature ;
+} verified NOINIT ;
+
+int warm_boot ;                 /* flash CRC check skipped */
+
+static void set_verified( int ok) {
+    verified.magic = ok ? WARM_MAGIC : 0 ;
+    verified.signature = SIGNATURE ;
+}
+
+static int is_warm_reset( void) {
+    unsigned flags = RCC_CSR ;
+
+    RCC_CSR |= RCC_CSR_RMVF ;   /* Clear flags, they accumulate otherwise */
+    return (flags & (RCC_CSR_SFTRSTF | RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF))
+        && !(flags & (RCC_CSR_PORRSTF | RCC_CSR_LPWRRSTF))
+        && verified.magic == WARM_MAGIC && verified.signature == SIGNATURE ;
+}
+
+# ifdef CRC32IDLE
+/* Background flash CRC validation: yield() calls check_flash_slice() until
+** flash_status is set, each call feeds CRC32IDLE words to CRC periph. CRC
+** state is carried between calls through CRC_INIT. Interrupts are not
+** masked, so SysTick and USART1 handlers are never delayed.
+*/
+int flash_status ;              /* 0: in progress, 1: valid, -1: corrupted */
+
+void flash_corrupted( void) __attribute__((weak)) ;
+void flash_corrupted( void) {   /* default: stop, as if checked at boot */
+    __asm( "CPSID i") ;
+    for( ;;)
+        __asm( "WFI") ;
+}
+
+void check_flash_slice( void) {
+    static const unsigned *wp ;
+    static unsigned crc = 0xFFFFFFFF ;
+    unsigned cnt ;
+
+    if( flash_status)
+        return ;
+
+    RCC_AHBENR |= RCC_AHBENR_CRCEN ;  /* Enable CRC periph */
+    CRC_INIT = crc ;
+    CRC_CR = 1 ;                      /* Reset to CRC_INIT */
+    if( CRC_DR != crc)                /* CRC periph is dead */
+        flash_status = -1 ;
+    else {
+        if( wp == 0)
+            wp = (const unsigned *) isr_vector ;
+
+        for( cnt = CRC32IDLE ; cnt && wp <= &crcsum ; cnt--)
+            CRC_DR = *wp++ ;
+
+        crc = CRC_DR ;
+        if( wp > &crcsum) {
+            flash_status = crc == 0 ? 1 : -1 ;
+            set_verified( flash_status > 0) ;
+        }
+    }
+
+    CRC_INIT = 0xFFFFFFFF ;           /* Default reset value */
+    RCC_AHBENR &= ~RCC_AHBENR_CRCEN ; /* Disable CRC periph */
+    if( flash_status < 0)
+        flash_corrupted() ;
+}
+# else
+/* Flash CRC validation: DMA channel 1 feeds CRC periph from flash, memory
+** to memory transfer of up to 65535 words, started before RAM is
+** initialized, so no state is kept in RAM.
+*/
+static void start_flash_check( void) {
+    RCC_AHBENR |= RCC_AHBENR_DMAEN | RCC_AHBENR_CRCEN ;  /* Enable DMA, CRC */
+    CRC_CR = 1 ;                      /* Reset */
+    if( CRC_DR == 0xFFFFFFFF) {       /* CRC periph is alive and resetted */
+        DMA_CMAR( 1) = (unsigned) isr_vector ;
+        DMA_CPAR( 1) = (unsigned) &CRC_DR ;
+        DMA_CNDTR( 1) = &crcsum - (const unsigned *) isr_vector + 1 ;
+        DMA_CCR( 1) = DMA_CCR_MEM2MEM | DMA_CCR_MSIZE32 | DMA_CCR_PSIZE32
+                    | DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN ;
+    }
+}
 
 static int check_flash( void) {
     int ret = 0 ;
 
-/* Flash CRC validation */
+    if( DMA_CCR( 1) & DMA_CCR_EN) {   /* Transfer started */
+        while( !(DMA_ISR & (DMA_ISR_TCIFn( 1) | DMA_ISR_TEIFn( 1)))) ;
+
+        ret = (DMA_ISR & DMA_ISR_TCIFn( 1)) && CRC_DR == 0 ;
+        DMA_IFCR = DMA_IFCR_CGIFn( 1) ;
+        DMA_CCR( 1) = 0 ;
+    }
+
+    RCC_AHBENR &= ~(RCC_AHBENR_DMAEN | RCC_AHBENR_CRCEN) ; /* Disable */
+    set_verified( ret) ;
+    return ret ;
+}
+# endif
+
+# if CRC32SIGN == 2
+/* Sector CRC table appended after crcsum by sign32 -s SECTOR_SIZE */
+#  define SECTOR_SIZE 1024
+extern const unsigned __crc_sect__[] ;
+
+int check_sector( unsigned idx) {
+    int ret = 0 ;
+    const unsigned *wp = (const unsigned *) isr_vector ;
+    unsigned nwords = __crc_sect__ - wp ;
+
+    if( idx >= (nwords * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE)
+        return 0 ;
+
+    wp += idx * SECTOR_SIZE / 4 ;
+    nwords -= idx * SECTOR_SIZE / 4 ;
+    if( nwords > SECTOR_SIZE / 4)
+        nwords = SECTOR_SIZE / 4 ;
+
     RCC_AHBENR |= RCC_AHBENR_CRCEN ;  /* Enable CRC periph */
     CRC_CR = 1 ;                      /* Reset */
     if( CRC_DR == 0xFFFFFFFF) {       /* CRC periph is alive and resetted */
-        const unsigned *wp = (const unsigned *) isr_vector ;
-        while( wp <= &crcsum)
+        while( nwords--)
             CRC_DR = *wp++ ;
 
-        ret = CRC_DR == 0 ;
+        ret = CRC_DR == __crc_sect__[ idx] ;
     }
 
     RCC_AHBENR &= ~RCC_AHBENR_CRCEN ; /* Disable CRC periph */
     return ret ;
 }
+# endif
 #endif
 
+/* Copy and zero RAM regions 16 bytes at a time using LDM/STM */
+static void copy_region( const long *f, long *t, unsigned size) {
+    for( ; size >= 16 ; size -= 16)
+        __asm volatile( "LDMIA %0!, {r4-r7}\n\tSTMIA %1!, {r4-r7}"
+                : "+l" (f), "+l" (t) : : "r4", "r5", "r6", "r7", "memory") ;
+
+    for( ; size ; size -= 4)
+        *t++ = *f++ ;
+}
+
+static void zero_region( long *t, unsigned size) {
+    register long z4 __asm( "r4") = 0 ;
+    register long z5 __asm( "r5") = 0 ;
+    register long z6 __asm( "r6") = 0 ;
+    register long z7 __asm( "r7") = 0 ;
+
+    for( ; size >= 16 ; size -= 16)
+        __asm volatile( "STMIA %0!, {%1, %2, %3, %4}" : "+l" (t)
+                : "r" (z4), "r" (z5), "r" (z6), "r" (z7) : "memory") ;
+
+    for( ; size ; size -= 4)
+        *t++ = 0 ;
+}
+
 void Reset_Handler( void) {
-    const long  *f ;    /* from, source constant data from FLASH */
-    long    *t ;        /* to, destination in RAM */
+#ifdef BOOTPROF
+    unsigned start ;
+#endif
+#ifdef CRC32SIGN
+    int warm ;
+#endif
 
-#if RAMISRV == 2
-/* Copy isr vector to beginning of RAM */
-    for( unsigned i = 0 ; i < ISRV_SIZE ; i++)
-        ram_vector[ i] = isr_vector[ i] ;
+#ifdef BOOTPROF
+    SYSTICK_RVR = 0xFFFFFF ;    /* free running count of HCLK cycles */
+    SYSTICK_CVR = 0 ;
+    SYSTICK_CSR = 5 ;           /* HCLK, Interrupt OFF, Enable */
+    for( int i = 0 ; i < BOOT_PHASES ; i++)
+        boot_prof[ i] = 0 ;
+
+    boot_last = 0xFFFFFF ;
+#endif
+    clock_init() ;          /* memory initialization at full speed */
+#ifdef BOOTPROF
+    start = SYSTICK_CVR ;
 #endif
 
-/* Assume:
-**  __bss_start__ == __data_end__
-**  All sections are 4 bytes aligned
-*/
-    f = __etext ;
-    for( t = __data_start__ ; t < __bss_start__ ; t += 1)
-        *t = *f++ ;
+#ifdef CRC32SIGN
+    warm = is_warm_reset() ;    /* .noinit record read before RAM init */
+# ifndef CRC32IDLE
+    if( !warm)
+        start_flash_check() ;   /* runs in background until main() */
+# endif
+#endif
 
-    while( t < &__bss_end__)
-        *t++ = 0 ;
+/* Initialize RAM regions, all sections are 4 bytes aligned */
+    for( copy_t *p = __copy_table_start__ ; p < __copy_table_end__ ; p++)
+        copy_region( p->src, p->dst, p->size) ;
+
+    boot_mark( BOOT_COPY) ;
+
+    for( zero_t *p = __zero_table_start__ ; p < __zero_table_end__ ; p++)
+        zero_region( p->dst, p->size) ;
+
+    boot_mark( BOOT_ZERO) ;
 
 /* Make sure active isr vector is mapped at 0x0 before enabling interrupts */
     RCC_APB2ENR |= RCC_APB2ENR_SYSCFGEN ;           /* Enable SYSCFG */
@@ -169,11 +367,34 @@ void Reset_Handler( void) {
     SYSCFG_CFGR1 &= ~3 ;                            /* Map FLASH at 0x0 */
 #endif
 
-    if(
+    boot_mark( BOOT_REMAP) ;
+
 #ifdef CRC32SIGN
-      check_flash() &&
+    warm_boot = warm ;
+# ifdef CRC32IDLE
+    if( warm)
+        flash_status = 1 ;
+# endif
+#endif
+#ifdef BOOTPROF
+    boot_cycles = (start - SYSTICK_CVR) & 0xFFFFFF ;
+#endif
+
+#if defined( CRC32SIGN) && !defined( CRC32IDLE)
+# ifdef BOOTPROF
+    int ok = warm || check_flash() ;    /* waited for before init() to time */
+
+    boot_mark( BOOT_CRC) ;
+#  define FLASH_OK  ok
+# else
+#  define FLASH_OK  (warm || check_flash())
+# endif
+#endif
+    if( init() == 0
+#if defined( CRC32SIGN) && !defined( CRC32IDLE)
+    && FLASH_OK
 #endif
-      init() == 0)
+    )
         main() ;
 
     for( ;;)
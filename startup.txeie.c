@@ -1,5 +1,8 @@
 /* startup.txeie.c -- entry point at reset and C startup
 ** Copyright (c) 2020-2021 Renaud Fivet
+** v9: boot phases timed when BOOTPROF
+** v8: RAM initialized from linker copy and zero tables, by 16 bytes
+** v7: clock setup before memory initialization, boot timing
 ** v6: device specific interrupts mapped
 ** v5: System Exceptions mapped
 ** v4: calls to init() and main()
@@ -9,14 +12,26 @@
 */
 
 #include "system.h" /* init() */
+#include "stm32f030xx.h"
 
 /* Memory locations defined by linker script */
 void __StackTop( void) ;        /* __StackTop points after end of stack */
 void Reset_Handler( void) ;     /* Entry point for execution */
-extern const long __etext[] ;   /* start of initialized data copy in flash */
-extern long __data_start__[] ;
-extern long __bss_start__[] ;
-extern long __bss_end__ ;       /* &__bss_end__ points after end of bss */
+
+/* RAM regions to initialize, tables defined by linker script */
+typedef const struct {
+    const long *src ;           /* initial value in FLASH */
+    long *dst ;                 /* region in RAM */
+    unsigned size ;             /* bytes, multiple of 4 */
+} copy_t ;
+
+typedef const struct {
+    long *dst ;                 /* region in RAM */
+    unsigned size ;             /* bytes, multiple of 4 */
+} zero_t ;
+
+extern copy_t __copy_table_start__[], __copy_table_end__[] ;
+extern zero_t __zero_table_start__[], __zero_table_end__[] ;
 
 /* Stubs for System Exception Handler */
 void Default_Handler( void) ;
@@ -110,20 +125,76 @@ isr_p const isr_vector[ 16 + 32] __attribute__((section(".isr_vector"))) = {
 
 int main( void) ;
 
-void Reset_Handler( void) {
-    const long  *f ;    /* from, source constant data from FLASH */
-    long    *t ;        /* to, destination in RAM */
+#ifdef BOOTPROF
+unsigned boot_cycles ;          /* HCLK cycles of memory initialization */
+unsigned boot_prof[ BOOT_PHASES] NOINIT ;  /* updated before RAM init */
+static unsigned boot_last NOINIT ;          /* SysTick at previous mark */
 
-/* Assume:
-**  __bss_start__ == __data_end__
-**  All sections are 4 bytes aligned
-*/
-    f = __etext ;
-    for( t = __data_start__ ; t < __bss_start__ ; t += 1)
-        *t = *f++ ;
+void boot_mark( enum bootphase phase) {
+    unsigned now = SYSTICK_CVR ;
+
+    boot_prof[ phase] = (boot_last - now) & 0xFFFFFF ;   /* 24-bit down */
+    boot_last = now ;
+}
+#endif
+
+/* Copy and zero RAM regions 16 bytes at a time using LDM/STM */
+static void copy_region( const long *f, long *t, unsigned size) {
+    for( ; size >= 16 ; size -= 16)
+        __asm volatile( "LDMIA %0!, {r4-r7}\n\tSTMIA %1!, {r4-r7}"
+                : "+l" (f), "+l" (t) : : "r4", "r5", "r6", "r7", "memory") ;
+
+    for( ; size ; size -= 4)
+        *t++ = *f++ ;
+}
+
+static void zero_region( long *t, unsigned size) {
+    register long z4 __asm( "r4") = 0 ;
+    register long z5 __asm( "r5") = 0 ;
+    register long z6 __asm( "r6") = 0 ;
+    register long z7 __asm( "r7") = 0 ;
 
-    while( t < &__bss_end__)
+    for( ; size >= 16 ; size -= 16)
+        __asm volatile( "STMIA %0!, {%1, %2, %3, %4}" : "+l" (t)
+                : "r" (z4), "r" (z5), "r" (z6), "r" (z7) : "memory") ;
+
+    for( ; size ; size -= 4)
         *t++ = 0 ;
+}
+
+void Reset_Handler( void) {
+#ifdef BOOTPROF
+    unsigned start ;
+#endif
+
+#ifdef BOOTPROF
+    SYSTICK_RVR = 0xFFFFFF ;    /* free running count of HCLK cycles */
+    SYSTICK_CVR = 0 ;
+    SYSTICK_CSR = 5 ;           /* HCLK, Interrupt OFF, Enable */
+    for( int i = 0 ; i < BOOT_PHASES ; i++)
+        boot_prof[ i] = 0 ;
+
+    boot_last = 0xFFFFFF ;
+#endif
+    clock_init() ;          /* memory initialization at full speed */
+#ifdef BOOTPROF
+    start = SYSTICK_CVR ;
+#endif
+
+/* Initialize RAM regions, all sections are 4 bytes aligned */
+    for( copy_t *p = __copy_table_start__ ; p < __copy_table_end__ ; p++)
+        copy_region( p->src, p->dst, p->size) ;
+
+    boot_mark( BOOT_COPY) ;
+
+    for( zero_t *p = __zero_table_start__ ; p < __zero_table_end__ ; p++)
+        zero_region( p->dst, p->size) ;
+
+    boot_mark( BOOT_ZERO) ;
+
+#ifdef BOOTPROF
+    boot_cycles = (start - SYSTICK_CVR) & 0xFFFFFF ;
+#endif
 
     if( init() == 0)
         main() ;
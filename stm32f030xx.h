@@ -43,6 +43,7 @@
 #define RCC_CFGR_PLLMUL( v)     ((v - 2) << 18)
 
 #define RCC_AHBENR              RCC[ 5]
+#define RCC_AHBENR_DMAEN        (1 << 0)    /*  0: DMA clock enable */
 #define RCC_AHBENR_CRCEN        (1 << 6)    /*  6: CRC clock enable */
 #define RCC_AHBENR_IOPn( n)     (1 << (17 + n))
 #define RCC_AHBENR_IOPh( h)     RCC_AHBENR_IOPn( CAT( 0x, h) - 0xA)
@@ -52,6 +53,14 @@
 #define RCC_APB2ENR_ADCEN       0x00000200  /*  9: ADC clock enable */
 #define RCC_APB2ENR_SYSCFGEN    0x00000001  /*  1: SYSCFG clock enable */
 
+#define RCC_CSR                 RCC[ 9]
+#define RCC_CSR_RMVF            (1 << 24)   /* 24: Remove reset flags */
+#define RCC_CSR_PORRSTF         (1 << 27)   /* 27: POR/PDR reset flag */
+#define RCC_CSR_SFTRSTF         (1 << 28)   /* 28: Software reset flag */
+#define RCC_CSR_IWDGRSTF        (1 << 29)   /* 29: Independent watchdog reset */
+#define RCC_CSR_WWDGRSTF        (1 << 30)   /* 30: Window watchdog reset */
+#define RCC_CSR_LPWRRSTF        (1 << 31)   /* 31: Low-power reset flag */
+
 #define RCC_CR2                 RCC[ 13]
 #define RCC_CR2_HSI14ON         0x00000001  /*  1: HSI14 clock enable */
 #define RCC_CR2_HSI14RDY        0x00000002  /*  2: HSI14 clock ready */
@@ -64,6 +73,24 @@
 #define CRC_INIT        CRC[ 4]
 
 
+#define DMA             ((volatile unsigned *) 0x40020000)
+#define DMA_ISR         DMA[ 0]
+#define DMA_ISR_TCIFn( n)   (2 << (4 * (n - 1)))    /* Transfer Complete */
+#define DMA_ISR_TEIFn( n)   (8 << (4 * (n - 1)))    /* Transfer Error */
+#define DMA_IFCR        DMA[ 1]
+#define DMA_IFCR_CGIFn( n)  (1 << (4 * (n - 1)))    /* Clear all flags */
+#define DMA_CCR( n)     DMA[ 2 + 5 * (n - 1)]       /* Channel n: 1..5 */
+#define DMA_CNDTR( n)   DMA[ 3 + 5 * (n - 1)]
+#define DMA_CPAR( n)    DMA[ 4 + 5 * (n - 1)]
+#define DMA_CMAR( n)    DMA[ 5 + 5 * (n - 1)]
+#define DMA_CCR_EN          1           /*  0: Channel enable */
+#define DMA_CCR_DIR         (1 << 4)    /*  4: Read from memory */
+#define DMA_CCR_MINC        (1 << 7)    /*  7: Memory increment mode */
+#define DMA_CCR_PSIZE32     (2 << 8)    /*  9-8: Peripheral size 32 bits */
+#define DMA_CCR_MSIZE32     (2 << 10)   /* 11-10: Memory size 32 bits */
+#define DMA_CCR_MEM2MEM     (1 << 14)   /* 14: Memory to memory mode */
+
+
 #define GPIOA                   ((volatile long *) 0x48000000)
 #define GPIOB                   ((volatile long *) 0x48000400)
 #define GPIO( x) CAT( GPIO, x)
@@ -2,13 +2,110 @@
 /* Copyright (c) 2020 Renaud Fivet  */
 
 extern volatile unsigned uptime ;   /* seconds elapsed since boot */
+unsigned now_us( void) ;                /* us since boot, wraps */
+unsigned long long now_us64( void) ;    /* us since boot */
+unsigned now_cycles( void) ;            /* HCLK cycles since boot, wraps */
+unsigned long long now_cycles64( void) ;    /* HCLK cycles since boot */
+
+/* RAM not initialized at boot, content survives a warm reset */
+#define NOINIT  __attribute__((section(".noinit")))
+
+/* Code copied to RAM at boot with .data, runs without flash wait state */
+#define RAMFUNC __attribute__((section(".ramfunc"), long_call, noinline))
 
 int init( void) ;           /* System initialization, called once at startup */
+void clock_init( void) ;    /* Clock setup, at reset before memory init */
+int clock_set( unsigned hz) ;   /* switch SYSCLK at runtime, 0 on success */
+unsigned clock_get( void) ;     /* current SYSCLK in Hz */
+
+/* BOOTPROF: boot phases timed with SysTick, printed by init() */
+enum bootphase {
+    BOOT_HSE,       /* HSE start */
+    BOOT_PLL,       /* PLL lock */
+    BOOT_COPY,      /* .copy.table: isr vector, .data, .ramfunc */
+    BOOT_ZERO,      /* .zero.table: .bss */
+    BOOT_REMAP,     /* isr vector mapping at 0x0 */
+    BOOT_CRC,       /* check_flash() */
+    BOOT_USART,     /* USART1 setup */
+    BOOT_PHASES
+} ;
+
+#ifdef BOOTPROF
+extern unsigned boot_cycles ;               /* HCLK cycles of memory init */
+extern unsigned boot_prof[ BOOT_PHASES] ;   /* cycles since previous phase */
+void boot_mark( enum bootphase phase) ;     /* end of phase */
+void boot_report( unsigned hz) ;            /* print boot durations */
+#else
+# define boot_mark( phase)
+#endif
+
+int check_sector( unsigned idx) ;   /* verify flash sector, CRC32SIGN == 2 */
+
+extern int warm_boot ;      /* CRC32SIGN: warm reset, flash check skipped */
+
+/* CRC32IDLE: flash verified in background from yield() */
+extern int flash_status ;           /* 0: in progress, 1: valid, -1: corrupted */
+void check_flash_slice( void) ;     /* verify next CRC32IDLE words of flash */
+void flash_corrupted( void) ;       /* called on mismatch, default stops */
 
 void kputc( unsigned char c) ;      /* character output */
 int  kputs( const char s[]) ;       /* string output */
 void yield( void) ;                 /* give way */
 
+/* adc.c idle manager: state selected by yield() */
+typedef enum {
+    IDLE_RUN,           /* not idle */
+    IDLE_SLEEP,         /* WFI while USART1 transmits */
+    IDLE_SLEEPONEXIT,   /* WFI, handlers request thread mode */
+    IDLE_STOP,          /* IDLESTOP: Stop mode, wake up on RTC alarm */
+    IDLE_STATES
+} idle_t ;
+
+unsigned idle_residency( idle_t state) ;    /* per mille of uptime */
+
+/* timer.c: software timers, ms resolution, callbacks run from yield() */
+typedef struct swtimer swtimer_t ;
+struct swtimer {
+    swtimer_t *next ;           /* wheel slot list */
+    swtimer_t **pprev ;         /* 0 when not armed */
+    unsigned expires ;          /* ms since boot */
+    unsigned period ;           /* ms, 0 for one-shot */
+    void (*fn)( void) ;
+} ;
+
+void timer_start( swtimer_t *t, unsigned ms, unsigned period,
+                                                        void (*fn)( void)) ;
+void timer_stop( swtimer_t *t) ;
+
+/* system layer hooks, defined when timer.c is linked */
+__attribute__((weak, long_call)) int timer_tick( unsigned ms) ; /* SysTick */
+__attribute__((weak)) int timer_run( void) ;                    /* yield() */
+
+/* task.c: cooperative tasks, yield() switches to the next ready one */
+int task_create( void (*fn)( void), unsigned long *stack, unsigned words) ;
+void task_sleep( unsigned ms) ;         /* yield() until ms elapsed */
+unsigned task_stack_free( int id) ;     /* words never used by task id */
+extern unsigned task_cycles ;           /* last context switch, HCLK cycles */
+extern unsigned task_cycles_max ;       /* worst context switch */
+
+__attribute__((weak)) int task_yield( void) ;   /* yield(), 1 if switched */
+
+/* event.c: events posted by handlers, callbacks dispatched by yield() */
+typedef enum {
+    EV_SECOND,          /* SysTick, arg: uptime */
+    EV_TXEMPTY,         /* USART1 transmit buffer drained */
+    EV_USER,            /* first application event */
+    EVENTS = 8
+} event_t ;
+
+int event_register( event_t id, void (*fn)( unsigned arg)) ;
+extern unsigned event_overflows ;       /* events lost, queue full */
+extern unsigned event_latency_max ;     /* HCLK cycles, post to dispatch */
+
+__attribute__((weak, long_call)) int event_post( event_t id, unsigned arg) ;
+__attribute__((weak)) int event_pending( void) ;    /* yield() */
+__attribute__((weak)) int event_dispatch( void) ;   /* yield() */
+
 /* GPIOA low level API ********************************************************/
 
 typedef enum {
@@ -18,9 +115,10 @@ typedef enum {
 
 void gpioa_input( int pin) ;        /* Configure GPIOA pin as input */
 void gpioa_output( int pin) ;       /* Configure GPIOA pin as output */
-iolvl_t  gpioa_read( int pin) ;     /* Read level of GPIOA pin */
+RAMFUNC iolvl_t gpioa_read( int pin) ;  /* Read level of GPIOA pin */
 
-void usleep( unsigned usecs) ;      /* wait at least usecs us */
+RAMFUNC void usleep( unsigned usecs) ;  /* wait at least usecs us */
+int usleep_async( unsigned usecs, void (*cb)( void)) ;  /* cb from ISR */
 
 typedef enum {
     VNT_INIT,
@@ -0,0 +1,192 @@
+/* task.c -- cooperative tasks, context switch by PendSV
+** Copyright (c) 2025 Renaud Fivet
+**
+** main() is task 0 on the system stack, task_create() adds tasks with their
+** own stack. yield() calls task_yield(): the calling task waits for an
+** interrupt and the next ready task runs. When every task waits, yield()
+** sleeps, all tasks are ready again once it returns.
+** Tasks run on MSP, interrupts are stacked on the current task stack, a task
+** stack budget covers 16 words of saved context plus the deepest interrupt
+** nesting on top of the task own usage.
+*/
+
+#include "system.h" /* implements system.h task API */
+
+
+/** CORE **********************************************************************/
+
+#define SYSTICK                 ((volatile unsigned long *) 0xE000E010)
+#define SYSTICK_CSR             SYSTICK[ 0]
+#define SYSTICK_RVR             SYSTICK[ 1]
+#define SYSTICK_CVR             SYSTICK[ 2]
+
+#define SCB_ICSR                (*(volatile long *) 0xE000ED04)
+#define SCB_ICSR_PENDSVSET      (1 << 28)   /* 28: PendSV pending */
+
+#define SCB_SHPR3               (*(volatile long *) 0xE000ED20)
+#define SCB_SHPR3_PRI_14        (0xC0 << 16)    /* PendSV lowest priority */
+
+
+/** Tasks *********************************************************************/
+
+#define TASKS       4               /* including main() */
+#define STACK_FILL  0x5A5A5A5A      /* stack high water mark */
+#define CONTEXT     16              /* words: r4-r11 and exception frame */
+
+typedef enum {
+    TASK_READY,
+    TASK_WAIT,                      /* until next interrupt */
+    TASK_DONE
+} state_t ;
+
+typedef struct {
+    unsigned long *sp ;             /* saved by PendSV_Handler, first member */
+    unsigned long *stack ;          /* lowest address, 0 for main() */
+    unsigned words ;                /* stack budget */
+    void (*fn)( void) ;
+    state_t state ;
+} task_t ;
+
+static task_t tasks[ TASKS] ;
+static int ntasks = 1 ;             /* main() */
+__attribute__((used)) static task_t *task_cur = tasks ;
+__attribute__((used)) static task_t *task_next ;
+
+static unsigned switch_start ;      /* SysTick count when PendSV is set */
+unsigned task_cycles ;              /* last context switch, HCLK cycles */
+unsigned task_cycles_max ;          /* worst context switch, HCLK cycles */
+
+/* Save r4-r11 of current task on its stack, restore next task ones, EXC_RETURN
+** in lr is unchanged: thread mode on MSP */
+__attribute__((naked)) void PendSV_Handler( void) {
+    __asm(
+    "   push    {r4-r7}         \n"
+    "   mov     r4, r8          \n"
+    "   mov     r5, r9          \n"
+    "   mov     r6, r10         \n"
+    "   mov     r7, r11         \n"
+    "   push    {r4-r7}         \n"
+    "   ldr     r0, =task_cur   \n"
+    "   ldr     r1, [r0]        \n"
+    "   mov     r2, sp          \n"
+    "   str     r2, [r1]        \n"     /* task_cur->sp = sp */
+    "   ldr     r1, =task_next  \n"
+    "   ldr     r1, [r1]        \n"
+    "   str     r1, [r0]        \n"     /* task_cur = task_next */
+    "   ldr     r2, [r1]        \n"
+    "   mov     sp, r2          \n"     /* sp = task_next->sp */
+    "   pop     {r4-r7}         \n"
+    "   mov     r8, r4          \n"
+    "   mov     r9, r5          \n"
+    "   mov     r10, r6         \n"
+    "   mov     r11, r7         \n"
+    "   pop     {r4-r7}         \n"
+    "   bx      lr              \n"
+    "   .ltorg                  \n"
+    ) ;
+}
+
+static void switched( void) {       /* resumed, account switch cost */
+    unsigned end = SYSTICK_CVR ;
+    unsigned cycles ;
+
+    cycles = switch_start >= end ? switch_start - end
+                                 : switch_start + SYSTICK_RVR + 1 - end ;
+    cycles *= SYSTICK_CSR & 4 ? 1 : 8 ;
+    task_cycles = cycles ;
+    if( cycles > task_cycles_max)
+        task_cycles_max = cycles ;
+
+    if( task_cur->stack && task_cur->stack[ 0] != STACK_FILL) {
+        __asm( "CPSID i") ;         /* stack overflow, stop */
+        for( ;;)
+            __asm( "WFI") ;
+    }
+}
+
+static void task_entry( void) {     /* first switch to a task */
+    switched() ;
+    task_cur->fn() ;
+    task_cur->state = TASK_DONE ;
+    for( ;;)
+        yield() ;
+}
+
+int task_create( void (*fn)( void), unsigned long *stack, unsigned words) {
+    task_t *t ;
+    unsigned long *sp ;
+
+    if( ntasks == TASKS || words < 2 * CONTEXT)
+        return -1 ;
+
+    SCB_SHPR3 |= SCB_SHPR3_PRI_14 ;     /* switch after pending interrupts */
+    for( unsigned i = 0 ; i < words ; i++)
+        stack[ i] = STACK_FILL ;
+
+/* initial context, top of stack 8 bytes aligned as on exception entry */
+    sp = (unsigned long *) ((unsigned long) (stack + words) & ~7UL) - CONTEXT ;
+    for( int i = 0 ; i < CONTEXT - 2 ; i++)
+        sp[ i] = 0 ;                /* r8-r11, r4-r7, r0-r3, r12, lr */
+
+    sp[ CONTEXT - 2] = (unsigned long) task_entry & ~1UL ;    /* pc */
+    sp[ CONTEXT - 1] = 0x01000000 ;                         /* xPSR: Thumb */
+
+    t = &tasks[ ntasks] ;
+    t->sp = sp ;
+    t->stack = stack ;
+    t->words = words ;
+    t->fn = fn ;
+    t->state = TASK_READY ;
+    return ntasks++ ;
+}
+
+int task_yield( void) {         /* yield(), nonzero when another task ran */
+    int idx = task_cur - tasks ;
+
+    if( task_cur->state != TASK_DONE)
+        task_cur->state = TASK_WAIT ;
+
+    for( int i = 1 ; i < ntasks ; i++) {
+        task_t *t = &tasks[ (idx + i) % ntasks] ;
+
+        if( t->state == TASK_READY) {
+            task_next = t ;
+            switch_start = SYSTICK_CVR ;
+            SCB_ICSR = SCB_ICSR_PENDSVSET ;
+            __asm( "DSB") ;
+            __asm( "ISB") ;         /* PendSV taken here */
+            switched() ;
+            return 1 ;
+        }
+    }
+
+/* all tasks wait, caller sleeps, any interrupt may unblock them */
+    for( int i = 0 ; i < ntasks ; i++)
+        if( tasks[ i].state == TASK_WAIT)
+            tasks[ i].state = TASK_READY ;
+
+    return 0 ;
+}
+
+static void expired( void) {}
+
+void task_sleep( unsigned ms) {     /* yield() until ms elapsed */
+    swtimer_t t = { 0 } ;
+
+    timer_start( &t, ms, 0, expired) ;
+    while( t.pprev)
+        yield() ;
+}
+
+unsigned task_stack_free( int id) { /* words never used, 0 for main() */
+    unsigned words = 0 ;
+
+    if( id > 0 && id < ntasks)
+        while( words < tasks[ id].words
+           &&  tasks[ id].stack[ words] == STACK_FILL)
+            words += 1 ;
+
+    return words ;
+}
+
+/* end of task.c */
@@ -0,0 +1,26 @@
+/* tasks.c -- two cooperative tasks and context switch cost */
+/* Copyright (c) 2025 Renaud Fivet */
+
+#include <stdio.h>
+#include "system.h"     /* uptime, task_create(), task_sleep() */
+
+static unsigned long stack[ 128] __attribute__((aligned( 8))) ;
+static int id ;
+
+static void report( void) {     /* every 5 seconds */
+    for( ;;) {
+        task_sleep( 5000) ;
+        printf( "switch %u cycles, max %u, stack %u words free\n",
+                    task_cycles, task_cycles_max, task_stack_free( id)) ;
+    }
+}
+
+int main( void) {
+    id = task_create( report, stack, sizeof stack / sizeof stack[ 0]) ;
+    for( ;;) {
+        task_sleep( 1000) ;
+        printf( "up %u\n", uptime) ;
+    }
+}
+
+/* end of tasks.c */
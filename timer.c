@@ -0,0 +1,133 @@
+/* timer.c -- software timers on a hierarchical timer wheel
+** Copyright (c) 2025 Renaud Fivet
+**
+** millisecond resolution, 4 levels of 16 slots, a slot of level n spans
+** 16^n ms. Timers due in more than 65535 ms wait in the last level and are
+** cascaded again until due.
+** SysTick_Handler only advances time with timer_tick(), cascading and expiry
+** are done in thread context by timer_run(), called from yield().
+*/
+
+#include "system.h" /* implements system.h timer API */
+
+#define LEVELS  4
+#define BITS    4                   /* 16 slots per level */
+#define SLOTS   (1 << BITS)
+#define SLOT( ms, lvl)  (((ms) >> ((lvl) * BITS)) & (SLOTS - 1))
+
+static swtimer_t *wheel[ LEVELS][ SLOTS] ;
+static volatile unsigned ticks ;    /* ms elapsed, advanced by SysTick */
+static unsigned done ;              /* next ms processed by timer_run() */
+
+static void insert( swtimer_t **head, swtimer_t *t) {
+    t->next = *head ;
+    if( t->next)
+        t->next->pprev = &t->next ;
+
+    t->pprev = head ;
+    *head = t ;
+}
+
+static void detach( swtimer_t *t) {
+    *t->pprev = t->next ;
+    if( t->next)
+        t->next->pprev = t->pprev ;
+
+    t->pprev = 0 ;
+}
+
+static void enqueue( swtimer_t *t) {    /* slot by distance from done */
+    unsigned delta = t->expires - done ;
+    int lvl ;
+    unsigned slot ;
+
+    for( lvl = 0 ; lvl < LEVELS - 1 ; lvl++)
+        if( delta < 1U << ((lvl + 1) * BITS))
+            break ;
+
+    if( delta < 1U << (LEVELS * BITS))
+        slot = SLOT( t->expires, lvl) ;
+    else    /* beyond the wheel, last slot before done wraps */
+        slot = (SLOT( done, lvl) + SLOTS - 1) & (SLOTS - 1) ;
+
+    insert( &wheel[ lvl][ slot], t) ;
+}
+
+void timer_start( swtimer_t *t, unsigned ms, unsigned period,
+                                                        void (*fn)( void)) {
+    if( t->pprev)
+        detach( t) ;
+
+    t->expires = ticks + (ms ? ms : 1) ;
+    t->period = period ;
+    t->fn = fn ;
+    enqueue( t) ;
+}
+
+void timer_stop( swtimer_t *t) {
+    if( t->pprev)
+        detach( t) ;
+}
+
+int timer_tick( unsigned ms) {  /* SysTick_Handler, nonzero if work is due */
+    unsigned now = ticks + ms ;
+
+    ticks = now ;
+    if( ms != 1)                /* coarse tick, always check */
+        return 1 ;
+
+/* at most one slot per level, upper levels only when lower one wraps */
+    for( int lvl = 0 ; lvl < LEVELS ; lvl++) {
+        if( wheel[ lvl][ SLOT( now, lvl)])
+            return 1 ;
+
+        if( SLOT( now, lvl) != 0)
+            break ;
+    }
+
+    return 0 ;
+}
+
+int timer_run( void) {          /* thread context, count of expired timers */
+    static int running ;        /* yield() from a callback */
+    int cnt = 0 ;
+
+    if( running)
+        return 0 ;
+
+    running = 1 ;
+    while( (int) (ticks - done) >= 0) {
+        swtimer_t **head ;
+        swtimer_t *t ;
+
+    /* cascade upper levels as lower ones wrap, highest first */
+        for( int lvl = LEVELS - 1 ; lvl > 0 ; lvl--)
+            if( (done & ((1U << (lvl * BITS)) - 1)) == 0) {
+                head = &wheel[ lvl][ SLOT( done, lvl)] ;
+                while( (t = *head) != 0) {
+                    detach( t) ;
+                    enqueue( t) ;
+                }
+            }
+
+    /* expire, periodic timers are rearmed before their callback */
+        head = &wheel[ 0][ SLOT( done, 0)] ;
+        while( (t = *head) != 0) {
+            detach( t) ;
+            if( t->period) {
+                t->expires += t->period ;
+                enqueue( t) ;
+            }
+
+            t->fn() ;
+            cnt += 1 ;
+        }
+
+        done += 1 ;
+    }
+
+    running = 0 ;
+    return cnt ;
+}
+
+/* end of timer.c */
@@ -7,6 +7,10 @@
 ** SysTick interrupt every second
 */
 
+#ifdef CRC32IDLE
+# error CRC32IDLE: no background flash check in this system layer
+#endif
+
 #define SYSTICK                 ((volatile long *) 0xE000E010)
 #define SYSTICK_CSR             SYSTICK[ 0]
 #define SYSTICK_RVR             SYSTICK[ 1]
@@ -10,6 +10,10 @@
 
 #include "system.h" /* implements system.h */
 
+#ifdef CRC32IDLE
+# error CRC32IDLE: no background flash check in this system layer
+#endif
+
 #define SYSTICK                 ((volatile long *) 0xE000E010)
 #define SYSTICK_CSR             SYSTICK[ 0]
 #define SYSTICK_RVR             SYSTICK[ 1]
@@ -71,6 +75,12 @@ int kputs( const char s[]) {    /* string output */
 }
 
 void yield( void) {             /* give way */
+    if( timer_run && timer_run())
+        return ;                /* timers expired, no wait */
+
+    if( task_yield && task_yield())
+        return ;                /* other tasks ran, no wait */
+
     __asm( "WFI") ; /* Wait for System Tick Interrupt */
 }
 
@@ -83,6 +93,9 @@ static void userLEDtoggle( void) {
 #endif
 
 void SysTick_Handler( void) {
+    if( timer_tick)
+        timer_tick( 1000) ;     /* 1s tick */
+
     uptime += 1 ;
 #ifdef LED_ON
     userLEDtoggle() ;
@@ -2,46 +2,48 @@
 /* Copyright (c) 2020-2025 Renaud Fivet                     */
 
 #include <stdio.h>
-#include "system.h" /* uptime, yield() */
+#include "system.h" /* uptime, yield(), timer_start() */
 
 static void display( unsigned u, const char *s) {
     if( u)
         printf( " %d %s%s", u, s, &"s"[ u <= 1]) ;
 }
 
-int main( void) {
-    unsigned last = 0 ;
-
-    for( ;;)
-        if( last != uptime) {
-            unsigned w, d, h, m ,s ;
+static void show( void) {       /* every second */
+    unsigned w, d, h, m ,s ;
+    unsigned last = uptime ;
 
-            last = uptime ;
-            d = h = m = 0 ;
-            s = last % 60 ;
-            w = last / 60 ;
+    d = h = m = 0 ;
+    s = last % 60 ;
+    w = last / 60 ;
+    if( w) {
+        m = w % 60 ;
+        w /= 60 ;
+        if( w) {
+            h = w % 24 ;
+            w /= 24 ;
             if( w) {
-                m = w % 60 ;
-                w /= 60 ;
-                if( w) {
-                    h = w % 24 ;
-                    w /= 24 ;
-                    if( w) {
-                        d = w % 7 ;
-                        w /= 7 ;
-                    }
-                }
+                d = w % 7 ;
+                w /= 7 ;
             }
+        }
+    }
+
+    printf( "up") ;
+    display( w, "week") ;
+    display( d, "day") ;
+    display( h, "hour") ;
+    display( m, "minute") ;
+    display( s, "second") ;
+    printf( "\n") ;
+}
+
+int main( void) {
+    static swtimer_t tick ;
 
-            printf( "up") ;
-            display( w, "week") ;
-            display( d, "day") ;
-            display( h, "hour") ;
-            display( m, "minute") ;
-            display( s, "second") ;
-            printf( "\n") ;
-        } else
-            yield() ;   /* Wait for System Tick Interrupt */
+    timer_start( &tick, 1000, 1000, show) ;
+    for( ;;)
+        yield() ;   /* timer callbacks run from yield() */
 }
 
 /* end of uptime.c */